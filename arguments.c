@@ -7,7 +7,9 @@
 
 void print_help_and_exit()
 {
-  printf("Usage: ./" PROGRAM_NAME " [-v] [-h] [-c command] [file]\n");
+  printf("Usage: ./" PROGRAM_NAME " [-v] [-h] [-c command] [file]\n"
+         "       ./" PROGRAM_NAME " --server socket [--jobs count]\n"
+         "       ./" PROGRAM_NAME " --client socket [command]\n");
   exit(EXIT_SUCCESS);
 }
 void print_version_and_exit()
@@ -8,6 +8,7 @@
 
 #include "ast.h"
 #include "logger.h"
+#include "memory.h"
 
 /**
  * @brief Trim the string provided.
@@ -47,20 +48,19 @@ void ast_free(AST *ast_pointer)
   {
   case AST_COMMAND:
     struct AST_COMMAND command = ast.data.AST_COMMAND;
-    free(command.executable);
+    memory_free(command.executable);
     for (size_t i = 1; i <= command.argc - 1; i++)
       ast_free(command.arguments[i]);
-    free(command.arguments);
+    memory_free(command.arguments);
     break;
   case AST_ARGUMENT:
     struct AST_ARGUMENT argument = ast.data.AST_ARGUMENT;
-    free(argument.value);
+    memory_free(argument.value);
     break;
   case AST_REDIRECTION:
     struct AST_REDIRECTION redirection = ast.data.AST_REDIRECTION;
     ast_free(redirection.command);
-    // free(redirection.file);
-    // TODO: Fix this somehow leaking memory
+    memory_free(redirection.file);
     break;
   case AST_PIPE:
     struct AST_PIPE pipe = ast.data.AST_PIPE;
@@ -78,13 +78,13 @@ void ast_free(AST *ast_pointer)
   case AST_LITERAL:
     struct AST_LITERAL literal = ast.data.AST_LITERAL;
     ast_free(literal.next);
-    free(literal.value);
+    memory_free(literal.value);
     break;
   default:
     logger(LOG_ERROR, "Unknown AST tag\n");
     break;
   }
-  free(ast_pointer);
+  memory_free(ast_pointer);
 }
 
 /**
@@ -157,12 +157,12 @@ AST *ast_parse_command(AST *ast, char *command)
     char *list_or_parallel_list = strchr(command, list_or_parallel_lists[i]);
     if (list_or_parallel_list != NULL)
     {
-      AST *new_ast = (AST *)malloc(sizeof(AST));
-      char *first_substring = (char *)calloc(list_or_parallel_list - command, sizeof(char));
-      strncpy(first_substring, command, list_or_parallel_list - command);
+      AST *new_ast = (AST *)memory_malloc(MEMORY_PARSER, sizeof(AST));
+      char *first_substring = memory_strndup(MEMORY_PARSER, command, list_or_parallel_list - command);
       new_ast->tag = AST_LIST;
       new_ast->data.AST_LIST.AST_LIST_TYPE = i == 0 ? AST_LIST_SEQUENTIAL : AST_LIST_PARALLEL;
       new_ast->data.AST_LIST.left = ast_parse_command(ast_new(), first_substring);
+      memory_free(first_substring);
       new_ast->data.AST_LIST.right = ast_parse_command(ast_new(), list_or_parallel_list + 1);
       ast = new_ast;
       return ast;
@@ -176,12 +176,12 @@ AST *ast_parse_command(AST *ast, char *command)
     char *and_or_list = strstr(command, and_or_lists[i]);
     if (and_or_list != NULL)
     {
-      AST *new_ast = (AST *)malloc(sizeof(AST));
-      char *first_substring = (char *)calloc(and_or_list - command, sizeof(char));
-      strncpy(first_substring, command, and_or_list - command);
+      AST *new_ast = (AST *)memory_malloc(MEMORY_PARSER, sizeof(AST));
+      char *first_substring = memory_strndup(MEMORY_PARSER, command, and_or_list - command);
       new_ast->tag = AST_LIST;
       new_ast->data.AST_LIST.AST_LIST_TYPE = i == 0 ? AST_LIST_OR : AST_LIST_AND;
       new_ast->data.AST_LIST.left = ast_parse_command(ast_new(), first_substring);
+      memory_free(first_substring);
       new_ast->data.AST_LIST.right = ast_parse_command(ast_new(), and_or_list + 2);
       ast = new_ast;
       return ast;
@@ -191,11 +191,11 @@ AST *ast_parse_command(AST *ast, char *command)
   char *pipe = strchr(command, '|');
   if (pipe != NULL)
   {
-    AST *new_ast = (AST *)malloc(sizeof(AST));
-    char *first_substring = (char *)calloc(pipe - command, sizeof(char));
-    strncpy(first_substring, command, pipe - command);
+    AST *new_ast = (AST *)memory_malloc(MEMORY_PARSER, sizeof(AST));
+    char *first_substring = memory_strndup(MEMORY_PARSER, command, pipe - command);
     new_ast->tag = AST_PIPE;
     new_ast->data.AST_PIPE.left = ast_parse_command(ast_new(), first_substring);
+    memory_free(first_substring);
     new_ast->data.AST_PIPE.right = ast_parse_command(ast_new(), pipe + 1);
     ast = new_ast;
     return ast;
@@ -210,16 +210,16 @@ AST *ast_parse_command(AST *ast, char *command)
     char *redirection = strstr(command, redirections[i]);
     if (redirection != NULL)
     {
-      AST *new_ast = (AST *)malloc(sizeof(AST));
-      char *first_substring = (char *)calloc(redirection - command, sizeof(char));
-      char *second_substring = (char *)calloc(strlen(redirection), sizeof(char));
-      strncpy(first_substring, command, redirection - command);
-      strcpy(second_substring, redirection + (i <= 1 ? 2 : 1));
-      second_substring = trim(second_substring);
+      AST *new_ast = (AST *)memory_malloc(MEMORY_PARSER, sizeof(AST));
+      char *first_substring = memory_strndup(MEMORY_PARSER, command, redirection - command);
+      char *second_substring = memory_strdup(MEMORY_PARSER, redirection + (i <= 1 ? 2 : 1));
       new_ast->tag = AST_REDIRECTION;
       new_ast->data.AST_REDIRECTION.AST_REDIRECTION_TYPE = i;
       new_ast->data.AST_REDIRECTION.command = ast_parse_command(ast_new(), first_substring);
-      new_ast->data.AST_REDIRECTION.file = second_substring;
+      // `trim()` moves the start of the string, keep a copy we are able to free
+      new_ast->data.AST_REDIRECTION.file = memory_strdup(MEMORY_PARSER, trim(second_substring));
+      memory_free(first_substring);
+      memory_free(second_substring);
 
       ast = new_ast;
       return ast;
@@ -236,10 +236,8 @@ AST *ast_parse_command(AST *ast, char *command)
       char *end = strchr(literal + 1, literals[i]);
       if (end == NULL)
         logger(LOG_ERROR, "Failed to parse string literal\n");
-      char *value = (char *)calloc(end - literal, sizeof(char));
-      strncpy(value, literal + 1, end - literal - 1);
-      value[end - literal - 1] = '\0';
-      AST *new_ast = (AST *)malloc(sizeof(AST));
+      char *value = memory_strndup(MEMORY_PARSER, literal + 1, end - literal - 1);
+      AST *new_ast = (AST *)memory_malloc(MEMORY_PARSER, sizeof(AST));
       new_ast->tag = AST_LITERAL;
       new_ast->data.AST_LITERAL.value = value;
       new_ast->data.AST_LITERAL.next = ast_parse_command(ast_new(), end + 1);
@@ -250,31 +248,29 @@ AST *ast_parse_command(AST *ast, char *command)
   // Commands and arguments
   char *tokens = " ";
   {
-    char *trimmed_command = trim(strdup(command));
-    if (strlen(trimmed_command) == 0)
-      return ast;
+    char *duplicated_command = memory_strdup(MEMORY_PARSER, command);
+    char *trimmed_command = trim(duplicated_command);
     char *token = strtok(trimmed_command, tokens);
     if (token == NULL)
+    {
+      memory_free(duplicated_command);
       return ast;
-    char *executable = (char *)calloc(strlen(token), sizeof(char));
-    strncpy(executable, token, strlen(token));
-    AST *new_ast = (AST *)malloc(sizeof(AST));
+    }
+    AST *new_ast = (AST *)memory_malloc(MEMORY_PARSER, sizeof(AST));
     new_ast->tag = AST_COMMAND;
-    new_ast->data.AST_COMMAND.executable = executable;
-    new_ast->data.AST_COMMAND.arguments = (AST **)malloc(sizeof(AST *));
+    new_ast->data.AST_COMMAND.executable = memory_strdup(MEMORY_PARSER, token);
+    new_ast->data.AST_COMMAND.arguments = (AST **)memory_malloc(MEMORY_PARSER, 2 * sizeof(AST *));
     size_t argc = 1;
     while ((token = strtok(NULL, tokens)) != NULL)
     {
-      // printf("%p: %s\n", token, token);
-      char *argument = (char *)calloc(strlen(token), sizeof(char));
-      strcpy(argument, token);
-      AST *argument_ast = (AST *)malloc(sizeof(AST));
-      argument_ast->data.AST_ARGUMENT.value = argument;
+      AST *argument_ast = (AST *)memory_malloc(MEMORY_PARSER, sizeof(AST));
+      argument_ast->data.AST_ARGUMENT.value = memory_strdup(MEMORY_PARSER, token);
       argument_ast->tag = AST_ARGUMENT;
-      new_ast->data.AST_COMMAND.arguments[argc] = argument_ast;
-      new_ast->data.AST_COMMAND.arguments = (AST **)realloc(new_ast->data.AST_COMMAND.arguments, (++argc) * sizeof(AST *));
+      new_ast->data.AST_COMMAND.arguments = (AST **)memory_realloc(MEMORY_PARSER, new_ast->data.AST_COMMAND.arguments, (argc + 1) * sizeof(AST *));
+      new_ast->data.AST_COMMAND.arguments[argc++] = argument_ast;
     }
     new_ast->data.AST_COMMAND.argc = argc;
+    memory_free(duplicated_command);
     return new_ast;
   }
 
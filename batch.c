@@ -0,0 +1,259 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "logger.h"
+#include "memory.h"
+#include "execution.h"
+#include "supervisor.h"
+#include "main.h"
+
+typedef struct
+{
+  // Reused for every batch: the command words followed by the items
+  char **arguments;
+  size_t fixed_count;
+  size_t count;
+  size_t capacity;
+  // Reused storage for the items read from the standard input
+  char *strings;
+  size_t strings_length;
+  size_t bytes;
+  size_t limit;
+  size_t max_arguments;
+  // The running batches, only our own children are waited for
+  supervisor *children;
+  size_t concurrency;
+  bool failed;
+  // The input of the commands, `-1` if the items are read from it
+  int32_t input;
+  FILE *output;
+} batch_state;
+
+/**
+ * @brief Bytes an argument occupies in the `execve()` argument area: the string and its pointer.
+ */
+static size_t batch_argument_size(char *argument)
+{
+  return strlen(argument) + 1 + sizeof(char *);
+}
+
+/**
+ * @brief Compute how many bytes of items fit in a single `execve()` next to the command words and the environment.
+ */
+static size_t batch_limit(char **command)
+{
+  long arg_max = sysconf(_SC_ARG_MAX);
+  if (arg_max <= 0)
+    arg_max = _POSIX_ARG_MAX;
+  size_t used = BATCH_HEADROOM + sizeof(char *);
+  for (char **variable = environ; *variable; variable++)
+    used += batch_argument_size(*variable);
+  for (; *command; command++)
+    used += batch_argument_size(*command);
+  return (size_t)arg_max > used ? (size_t)arg_max - used : 0;
+}
+
+/**
+ * @brief Wait for whichever batch started by us finishes first and record its result.
+ * The stages of the pipeline we may be running in are not ours to reap.
+ * @return `false` if no batch is running anymore.
+ */
+static bool batch_wait_one(batch_state *state)
+{
+  ssize_t finished = supervisor_wait_any(state->children, -1);
+  if (finished < 0)
+    return false;
+  if (supervisor_status(state->children, finished) != EXIT_SUCCESS)
+    state->failed = true;
+  return true;
+}
+
+/**
+ * @brief Execute the pending items as one command, then start over with an empty batch.
+ */
+static void batch_flush(batch_state *state)
+{
+  if (state->count == state->fixed_count)
+    return;
+  if (state->children->running == state->concurrency)
+    batch_wait_one(state);
+  state->arguments[state->count] = NULL;
+  fflush(state->output);
+  pid_t pid = execution_fork();
+  if (pid == -1)
+  {
+    logger(LOG_WARNING, "Failed to fork.\n");
+    state->failed = true;
+  }
+  else if (pid == 0)
+  {
+    // Like `xargs`, the commands must not consume the items, nor the commands of the shell
+    int32_t input = state->input == -1 ? open("/dev/null", O_RDONLY) : state->input;
+    if (input != -1 && input != STDIN_FILENO)
+      dup2(input, STDIN_FILENO);
+    if (fileno(state->output) != STDOUT_FILENO)
+      dup2(fileno(state->output), STDOUT_FILENO);
+    execvp(state->arguments[0], state->arguments);
+    logger(LOG_WARNING, "Failed to execute command.\n");
+    _exit(EXIT_FAILURE);
+  }
+  else
+    supervisor_add(state->children, pid);
+  // The child has its own copy of the buffers, they are free to be reused
+  state->count = state->fixed_count;
+  state->strings_length = 0;
+  state->bytes = 0;
+}
+
+/**
+ * @brief Add an item to the current batch, executing the batch first if the item does not fit anymore.
+ * @param copy Copy the item into the reused string storage instead of referring to it.
+ */
+static void batch_add(batch_state *state, char *item, bool copy)
+{
+  size_t size = batch_argument_size(item);
+  if (size > state->limit)
+  {
+    logger(LOG_WARNING, "Argument too long for a single command, skipped.\n");
+    state->failed = true;
+    return;
+  }
+  if (state->bytes + size > state->limit ||
+      (state->max_arguments != 0 && state->count - state->fixed_count == state->max_arguments))
+    batch_flush(state);
+  if (state->count + 1 >= state->capacity)
+  {
+    state->capacity *= 2;
+    state->arguments = memory_realloc(MEMORY_BUILTINS, state->arguments, state->capacity * sizeof(char *));
+  }
+  if (copy)
+  {
+    // Every batch fits in `limit` bytes, so does the copy of its strings
+    char *stored = state->strings + state->strings_length;
+    strcpy(stored, item);
+    state->strings_length += strlen(item) + 1;
+    item = stored;
+  }
+  state->arguments[state->count++] = item;
+  state->bytes += size;
+}
+
+/**
+ * @brief Parse a positive number option.
+ * @return `0` if the value is not a positive number.
+ */
+static size_t batch_parse_number(char *value)
+{
+  if (value == NULL)
+    return 0;
+  char *end = NULL;
+  long number = strtol(value, &end, 10);
+  if (*value == '\0' || *end != '\0' || number <= 0)
+    return 0;
+  return number;
+}
+
+/**
+ * @brief Read a line of the input into the growing buffer, without its newline.
+ * @return The length of the line, `-1` at the end of input.
+ */
+static ssize_t batch_read_line(FILE *input, char **line, size_t *capacity)
+{
+  size_t length = 0;
+  while (fgets(*line + length, *capacity - length, input) != NULL)
+  {
+    length += strlen(*line + length);
+    if (length > 0 && (*line)[length - 1] == '\n')
+    {
+      (*line)[--length] = '\0';
+      return length;
+    }
+    if (length + 1 == *capacity)
+    {
+      *capacity *= 2;
+      *line = memory_realloc(MEMORY_BUILTINS, *line, *capacity);
+    }
+  }
+  return length > 0 ? (ssize_t)length : -1;
+}
+
+/**
+ * @brief Run a command over many items with as few `execve()` as possible, like `xargs`.
+ * `batch [-P concurrency] [-n max_arguments] command [arguments...] [-- items...]`
+ * Without `--`, the items are read from the input, one per line, and the commands read `/dev/null`.
+ * When the shell reads its own commands from the standard input, the lines it already buffered are not seen by `batch`.
+ * @return `EXIT_SUCCESS` if every batch succeeded.
+ */
+int32_t batch(int32_t argc, char **argv, FILE *input, FILE *output)
+{
+  batch_state state = {0};
+  state.concurrency = 1;
+  state.input = -1;
+  state.output = output;
+  int32_t index = 1;
+  for (; index < argc && argv[index][0] == '-' && strcmp(argv[index], "--") != 0; index += 2)
+  {
+    size_t value = batch_parse_number(index + 1 < argc ? argv[index + 1] : NULL);
+    if (strcmp(argv[index], "-P") == 0 && value != 0)
+      state.concurrency = value;
+    else if (strcmp(argv[index], "-n") == 0 && value != 0)
+      state.max_arguments = value;
+    else
+    {
+      fprintf(stderr, "Usage: batch [-P concurrency] [-n max_arguments] command [arguments...] [-- items...]\n");
+      return EXIT_FAILURE;
+    }
+  }
+  int32_t separator = index;
+  while (separator < argc && strcmp(argv[separator], "--") != 0)
+    separator++;
+  if (separator == index)
+  {
+    fprintf(stderr, "Usage: batch [-P concurrency] [-n max_arguments] command [arguments...] [-- items...]\n");
+    return EXIT_FAILURE;
+  }
+  state.fixed_count = separator - index;
+  state.count = state.fixed_count;
+  state.capacity = state.fixed_count + BATCH_ARGUMENTS_SIZE;
+  state.arguments = memory_calloc(MEMORY_BUILTINS, state.capacity, sizeof(char *));
+  memcpy(state.arguments, argv + index, state.fixed_count * sizeof(char *));
+  state.arguments[state.count] = NULL;
+  state.limit = batch_limit(state.arguments);
+  state.children = supervisor_new();
+
+  if (separator < argc)
+  {
+    state.input = fileno(input);
+    for (int32_t i = separator + 1; i < argc; i++)
+      batch_add(&state, argv[i], false);
+  }
+  else
+  {
+    state.strings = memory_malloc(MEMORY_BUILTINS, state.limit + 1);
+    size_t capacity = BATCH_LINE_SIZE;
+    char *line = memory_malloc(MEMORY_BUILTINS, capacity);
+    ssize_t read = 0;
+    while ((read = batch_read_line(input, &line, &capacity)) != -1)
+      if (read > 0)
+        batch_add(&state, line, true);
+    // The end of a terminal is only the end of this batch
+    clearerr(input);
+    memory_free(line);
+  }
+  batch_flush(&state);
+  while (batch_wait_one(&state))
+    ;
+
+  memory_free(state.arguments);
+  memory_free(state.strings);
+  supervisor_free(state.children);
+  return state.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
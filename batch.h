@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Bytes left unused below `ARG_MAX`, like `xargs` does
+#define BATCH_HEADROOM 2048
+#define BATCH_ARGUMENTS_SIZE 1024
+#define BATCH_LINE_SIZE 256
+
+int32_t batch(int32_t argc, char **argv, FILE *input, FILE *output);
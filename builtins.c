@@ -7,16 +7,31 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <math.h>
+#include <pthread.h>
 
 #include "logger.h"
 #include "main.h"
+#include "memory.h"
+#include "batch.h"
+#include "transfer.h"
+#include "supervisor.h"
+#include "execution.h"
+#include "bulitins.h"
+#include "completion.h"
+
+// Set by `bye()`, the main loop exits once the current command is freed
+bool builtin_exit_requested = false;
 
 /**
- * @brief exit the shell.
+ * @brief exit the shell, after the command line is freed by the main loop.
  */
-void bye()
+int32_t bye()
 {
-  exit(EXIT_SUCCESS);
+  builtin_exit_requested = true;
+  return EXIT_SUCCESS;
 }
 
 /**
@@ -45,11 +60,8 @@ int32_t cd(char *path)
  */
 int32_t env(FILE *stream)
 {
-  while (*environ)
-  {
-    fprintf(stream, "%s\n", *environ);
-    environ++;
-  }
+  for (char **variable = environ; *variable; variable++)
+    fprintf(stream, "%s\n", *variable);
   return EXIT_SUCCESS;
 }
 
@@ -60,23 +72,263 @@ int32_t env(FILE *stream)
  */
 int32_t path(char **path)
 {
-  char *new_path = "";
-  path++;
-  while (*path)
+  size_t length = 1;
+  for (char **directory = path + 1; *directory; directory++)
+    length += strlen(*directory) + 1;
+  char *new_path = memory_calloc(MEMORY_VARIABLES, length, sizeof(char));
+  for (char **directory = path + 1; *directory; directory++)
   {
-    if (new_path == NULL)
-      new_path = *path;
-    else
-    {
-      new_path = realloc(new_path, strlen(new_path) + strlen(*path) + 2);
+    if (directory != path + 1)
       strcat(new_path, ":");
-      strcat(new_path, *path);
+    strcat(new_path, *directory);
+  }
+  // `setenv()` keeps its own copy
+  int32_t result = setenv("PATH", new_path, 1);
+  memory_free(new_path);
+  completion_invalidate();
+  return result;
+}
+
+/**
+ * @brief Print the memory statistics of every subsystem to the stream.
+ */
+int32_t memstat(FILE *stream)
+{
+  memory_print_statistics(stream);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Check if any argument from `index` on is an option, which the built-in commands do not know.
+ */
+static bool builtin_has_options(int32_t argc, char **argv, int32_t index)
+{
+  for (int32_t i = index; i <= argc - 1; i++)
+    if (argv[i][0] == '-' && argv[i][1] != '\0')
+      return true;
+  return false;
+}
+
+/**
+ * @brief Run the system command of the same name on the streams, for the options a built-in command does not know.
+ * @return The exit status of the system command.
+ */
+static int32_t builtin_run_external(char **argv, FILE *input, FILE *output)
+{
+  pid_t pid = execution_fork();
+  if (pid == -1)
+  {
+    logger(LOG_WARNING, "Failed to fork.\n");
+    return EXIT_FAILURE;
+  }
+  if (pid == 0)
+  {
+    if (fileno(input) != STDIN_FILENO)
+      dup2(fileno(input), STDIN_FILENO);
+    if (fileno(output) != STDOUT_FILENO)
+      dup2(fileno(output), STDOUT_FILENO);
+    execvp(argv[0], argv);
+    logger(LOG_WARNING, "Failed to execute command.\n");
+    _exit(EXIT_FAILURE);
+  }
+  return supervisor_wait_one(pid);
+}
+
+/**
+ * @brief Concatenate the files (or the input if none or `-` is given) to the output.
+ * With any option, `cat` from the `PATH` is run instead.
+ */
+int32_t cat(int32_t argc, char **argv, FILE *input, FILE *output)
+{
+  fflush(output);
+  if (builtin_has_options(argc, argv, 1))
+    return builtin_run_external(argv, input, output);
+  if (argc == 1)
+    return transfer_copy(fileno(input), fileno(output));
+  int32_t result = EXIT_SUCCESS;
+  for (int32_t i = 1; i <= argc - 1; i++)
+  {
+    if (strcmp(argv[i], "-") == 0)
+    {
+      result |= transfer_copy(fileno(input), fileno(output));
+      continue;
+    }
+    int32_t file_descriptor = open(argv[i], O_RDONLY | O_CLOEXEC);
+    if (file_descriptor == -1)
+    {
+      logger(LOG_WARNING, "Failed to open file.\n");
+      result = EXIT_FAILURE;
+      continue;
+    }
+    result |= transfer_copy(file_descriptor, fileno(output));
+    close(file_descriptor);
+  }
+  return result;
+}
+
+/**
+ * @brief Copy the input to the output and to every file, `-a` appends to the files instead of truncating them.
+ * With any other option, `tee` from the `PATH` is run instead.
+ */
+int32_t tee_builtin(int32_t argc, char **argv, FILE *input, FILE *output)
+{
+  fflush(output);
+  int32_t flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  int32_t index = 1;
+  if (argc >= 2 && strcmp(argv[1], "-a") == 0)
+  {
+    flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+    index++;
+  }
+  if (builtin_has_options(argc, argv, index))
+    return builtin_run_external(argv, input, output);
+  int32_t result = EXIT_SUCCESS;
+  int32_t *outputs = memory_calloc(MEMORY_BUILTINS, argc, sizeof(int32_t));
+  size_t count = 0;
+  outputs[count++] = fileno(output);
+  for (; index <= argc - 1; index++)
+  {
+    int32_t file_descriptor = open(argv[index], flags, 0644);
+    if (file_descriptor == -1)
+    {
+      logger(LOG_WARNING, "Failed to open file.\n");
+      result = EXIT_FAILURE;
+      continue;
+    }
+    outputs[count++] = file_descriptor;
+  }
+  result |= transfer_tee(fileno(input), outputs, count);
+  for (size_t i = 1; i <= count - 1; i++)
+    close(outputs[i]);
+  memory_free(outputs);
+  return result;
+}
+
+/**
+ * @brief Parse a duration such as `10`, `1.5s`, `2m`, `1h`, `1d` or `inf`.
+ * @return The duration in milliseconds, at most `DURATION_MAX`, `-1` if it is invalid.
+ */
+int64_t parse_duration(char *duration)
+{
+  char *end = NULL;
+  double value = strtod(duration, &end);
+  if (end == duration || isnan(value) || value < 0)
+    return -1;
+  double unit = 0;
+  if (*end == '\0' || strcmp(end, "s") == 0)
+    unit = 1000;
+  else if (strcmp(end, "m") == 0)
+    unit = 60 * 1000;
+  else if (strcmp(end, "h") == 0)
+    unit = 60 * 60 * 1000;
+  else if (strcmp(end, "d") == 0)
+    unit = 24 * 60 * 60 * 1000;
+  else
+    return -1;
+  // Checked before the conversion, out of range it is undefined
+  double milliseconds = value * unit;
+  if (!isfinite(milliseconds) || milliseconds >= DURATION_MAX)
+    return DURATION_MAX;
+  return milliseconds;
+}
+
+/**
+ * @brief Give the terminal to the process group, the other groups are stopped if they read it.
+ */
+static void builtin_set_foreground(int32_t terminal, pid_t group)
+{
+  // From a background group, `tcsetpgrp()` would stop the caller with `SIGTTOU`
+  sigset_t signals, previous;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTTOU);
+  pthread_sigmask(SIG_BLOCK, &signals, &previous);
+  tcsetpgrp(terminal, group);
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+/**
+ * @brief Run the command and send it `SIGTERM` once the duration passed, then `SIGKILL` if it is still alive
+ * after the kill duration (`-k`, `TIMEOUT_KILL_AFTER` by default). The deadline is watched on the pidfd of the
+ * command, no process is started besides the command itself.
+ * The command leads its own process group and the signals go to the whole group, so the processes it started
+ * do not outlive it and keep a pipeline open. If the input is the terminal of the shell, the group is given the
+ * terminal until the command ends.
+ * @return The exit status of the command, `TIMEOUT_STATUS` if it timed out, or `128 + SIGKILL` if it had to be
+ * killed.
+ */
+int32_t timeout(int32_t argc, char **argv, FILE *input, FILE *output)
+{
+  int64_t kill_after = TIMEOUT_KILL_AFTER;
+  int32_t index = 1;
+  if (argc >= 3 && strcmp(argv[1], "-k") == 0)
+  {
+    kill_after = parse_duration(argv[2]);
+    index += 2;
+  }
+  int64_t duration = index <= argc - 1 ? parse_duration(argv[index]) : -1;
+  if (duration < 0 || kill_after < 0 || index + 1 > argc - 1)
+  {
+    fprintf(stderr, "Usage: timeout [-k kill_after] duration command [arguments...]\n");
+    return EXIT_FAILURE;
+  }
+  char **command = argv + index + 1;
+  int32_t terminal = fileno(input);
+  bool foreground = isatty(terminal) && tcgetpgrp(terminal) == getpgrp();
+  fflush(output);
+  pid_t pid = execution_fork();
+  if (pid == -1)
+  {
+    logger(LOG_WARNING, "Failed to fork.\n");
+    return EXIT_FAILURE;
+  }
+  if (pid == 0)
+  {
+    setpgid(0, 0);
+    if (foreground)
+      builtin_set_foreground(terminal, getpid());
+    if (fileno(input) != STDIN_FILENO)
+      dup2(fileno(input), STDIN_FILENO);
+    if (fileno(output) != STDOUT_FILENO)
+      dup2(fileno(output), STDOUT_FILENO);
+    if (scan_builtin(command[0]))
+      exit(run_builtin(argc - index - 1, command, stdin, stdout));
+    execvp(command[0], command);
+    logger(LOG_WARNING, "Failed to execute command.\n");
+    _exit(EXIT_FAILURE);
+  }
+  // Also set here, the group must exist before it is signaled or given the terminal
+  setpgid(pid, pid);
+  if (foreground)
+    builtin_set_foreground(terminal, pid);
+  supervisor *children = supervisor_new();
+  supervisor_add(children, pid);
+  // A zero duration disables the timeout, like the longest one
+  bool unlimited = duration == 0 || duration == DURATION_MAX;
+  bool timed_out = supervisor_wait_any(children, unlimited ? -1 : supervisor_now() + duration) == SUPERVISOR_TIMEOUT;
+  bool killed = false;
+  if (timed_out)
+  {
+    supervisor_signal_group(children, 0, SIGTERM);
+    // A stopped command would only handle `SIGTERM` once continued
+    supervisor_signal_group(children, 0, SIGCONT);
+    if (supervisor_wait_any(children, kill_after == DURATION_MAX ? -1 : supervisor_now() + kill_after) ==
+        SUPERVISOR_TIMEOUT)
+    {
+      supervisor_signal_group(children, 0, SIGKILL);
+      supervisor_wait_any(children, -1);
+      killed = true;
     }
-    path++;
   }
-  return setenv("PATH", new_path, 1);
+  if (foreground)
+    builtin_set_foreground(terminal, getpgrp());
+  int32_t status = killed ? 128 + SIGKILL : timed_out ? TIMEOUT_STATUS : supervisor_status(children, 0);
+  supervisor_free(children);
+  return status;
 }
 
+// Every built-in command, for the completion
+char *builtin_names[] = {"bye", "exit", "cd", "path", "env", "memstat", "batch", "cat", "tee", "timeout", NULL};
+
 /**
  * @brief Scan if the command is a built-in command.
  * @return `true` if the command is a built-in command, `false` otherwise.
@@ -91,21 +343,56 @@ bool scan_builtin(char *search)
     return true;
   if (strcmp(search, "env") == 0)
     return true;
+  if (strcmp(search, "memstat") == 0)
+    return true;
+  if (strcmp(search, "batch") == 0)
+    return true;
+  if (strcmp(search, "cat") == 0)
+    return true;
+  if (strcmp(search, "tee") == 0)
+    return true;
+  if (strcmp(search, "timeout") == 0)
+    return true;
+  return false;
+}
+
+/**
+ * @brief Scan if the built-in command is able to run on a thread of the shell in a pipeline.
+ * Such built-in commands only use the given streams and MUST NOT change the state of the process
+ * (working directory, environment variables, exiting).
+ * @return `true` if the command is a built-in command safe to run on a thread, `false` otherwise.
+ */
+bool scan_threaded_builtin(char *search)
+{
+  if (strcmp(search, "env") == 0)
+    return true;
+  if (strcmp(search, "memstat") == 0)
+    return true;
+  if (strcmp(search, "batch") == 0)
+    return true;
+  if (strcmp(search, "cat") == 0)
+    return true;
+  if (strcmp(search, "tee") == 0)
+    return true;
+  if (strcmp(search, "timeout") == 0)
+    return true;
   return false;
 }
 
 /**
  * @brief Run the built-in command.
  * This function SHOULD only be called after `scan_builtin()` and the result is true.
+ * @param input The standard input of the built-in command.
+ * @param output The standard output of the built-in command.
  * @return The return value of the built-in command.
  */
-int32_t run_builtin(int32_t argc, char **argv)
+int32_t run_builtin(int32_t argc, char **argv, FILE *input, FILE *output)
 {
   if (argc == 0 || argv == NULL || argv[0] == NULL)
     logger(LOG_ERROR, "No arguments provided for the built-in command.\n");
   if (strcmp(argv[0], "bye") == 0 || strcmp(argv[0], "exit") == 0)
   {
-    bye();
+    return bye();
   }
   if (strcmp(argv[0], "cd") == 0)
   {
@@ -119,7 +406,27 @@ int32_t run_builtin(int32_t argc, char **argv)
   }
   if (strcmp(argv[0], "env") == 0)
   {
-    return env(stdout);
+    return env(output);
+  }
+  if (strcmp(argv[0], "memstat") == 0)
+  {
+    return memstat(output);
+  }
+  if (strcmp(argv[0], "batch") == 0)
+  {
+    return batch(argc, argv, input, output);
+  }
+  if (strcmp(argv[0], "cat") == 0)
+  {
+    return cat(argc, argv, input, output);
+  }
+  if (strcmp(argv[0], "tee") == 0)
+  {
+    return tee_builtin(argc, argv, input, output);
+  }
+  if (strcmp(argv[0], "timeout") == 0)
+  {
+    return timeout(argc, argv, input, output);
   }
   logger(LOG_ERROR, "Unknown built-in command.\n");
   return EXIT_FAILURE;
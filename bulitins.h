@@ -1,6 +1,20 @@
 #pragma once
 
 #include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Exit status of a command killed by `timeout`, like coreutils
+#define TIMEOUT_STATUS 124
+// Milliseconds between `SIGTERM` and `SIGKILL`
+#define TIMEOUT_KILL_AFTER 5000
+// Longest duration in milliseconds, longer ones and `inf` never expire
+#define DURATION_MAX ((int64_t)1 << 52)
+
+extern char *builtin_names[];
+extern bool builtin_exit_requested;
 
 bool scan_builtin(char *search);
-int32_t run_builtin(int32_t argc, char **argv);
\ No newline at end of file
+bool scan_threaded_builtin(char *search);
+int32_t run_builtin(int32_t argc, char **argv, FILE *input, FILE *output);
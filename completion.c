@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "completion.h"
+#include "bulitins.h"
+#include "logger.h"
+#include "memory.h"
+
+/**
+ * @brief A node of the trie, stored in an array and linked by indexes (the root is `0`, so `0` means none).
+ * The children of a node are sorted by character.
+ */
+typedef struct
+{
+  unsigned char character;
+  bool terminal;
+  uint32_t child;
+  uint32_t sibling;
+} completion_node;
+
+typedef struct
+{
+  completion_node *nodes;
+  size_t count;
+  size_t capacity;
+  // What the trie was built from, rebuilt when any of it changes
+  char *path;
+  char **directories;
+  struct timespec *modified;
+  size_t directory_count;
+  bool valid;
+} completion_trie;
+
+static completion_trie trie;
+
+/**
+ * @brief Make the next completion rebuild the trie, called when the `PATH` is changed.
+ */
+void completion_invalidate()
+{
+  trie.valid = false;
+}
+
+/**
+ * @brief Allocate a node in front of the sibling.
+ */
+static uint32_t completion_node_new(unsigned char character, uint32_t sibling)
+{
+  if (trie.count == trie.capacity)
+  {
+    trie.capacity = trie.capacity == 0 ? COMPLETION_NODES_SIZE : trie.capacity * 2;
+    trie.nodes = memory_realloc(MEMORY_EDITOR, trie.nodes, trie.capacity * sizeof(completion_node));
+  }
+  trie.nodes[trie.count] = (completion_node){character, false, 0, sibling};
+  return trie.count++;
+}
+
+/**
+ * @brief Insert the name in the trie.
+ */
+static void completion_insert(char *name)
+{
+  uint32_t node = 0;
+  for (unsigned char *character = (unsigned char *)name; *character; character++)
+  {
+    uint32_t previous = 0, current = trie.nodes[node].child;
+    while (current != 0 && trie.nodes[current].character < *character)
+    {
+      previous = current;
+      current = trie.nodes[current].sibling;
+    }
+    if (current == 0 || trie.nodes[current].character != *character)
+    {
+      // `trie.nodes` may move, only indexes are kept across this call
+      uint32_t created = completion_node_new(*character, current);
+      if (previous == 0)
+        trie.nodes[node].child = created;
+      else
+        trie.nodes[previous].sibling = created;
+      current = created;
+    }
+    node = current;
+  }
+  trie.nodes[node].terminal = true;
+}
+
+/**
+ * @brief Forget the directories the trie was built from.
+ */
+static void completion_clear()
+{
+  for (size_t i = 0; i < trie.directory_count; i++)
+    memory_free(trie.directories[i]);
+  memory_free(trie.directories);
+  memory_free(trie.modified);
+  memory_free(trie.path);
+  trie.directories = NULL;
+  trie.modified = NULL;
+  trie.path = NULL;
+  trie.directory_count = 0;
+}
+
+/**
+ * @brief The modification time of the directory, zero if it does not exist.
+ */
+static struct timespec completion_modified(char *directory)
+{
+  struct stat status;
+  if (stat(directory, &status) == -1)
+    return (struct timespec){0, 0};
+  return status.st_mtim;
+}
+
+/**
+ * @brief Insert the executables of the directory.
+ */
+static void completion_scan(char *directory)
+{
+  DIR *stream = opendir(directory);
+  if (stream == NULL)
+    return;
+  struct dirent *entry;
+  while ((entry = readdir(stream)) != NULL)
+  {
+    if (entry->d_type == DT_DIR || strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    struct stat status;
+    if (entry->d_type != DT_REG &&
+        (fstatat(dirfd(stream), entry->d_name, &status, 0) == -1 || !S_ISREG(status.st_mode)))
+      continue;
+    if (faccessat(dirfd(stream), entry->d_name, X_OK, 0) == 0)
+      completion_insert(entry->d_name);
+  }
+  closedir(stream);
+}
+
+/**
+ * @brief Rebuild the trie if the `PATH`, or the content of any of its directories, changed since it was built.
+ * Checking costs a `stat()` per directory, rebuilding a `readdir()` of every directory.
+ */
+static void completion_refresh()
+{
+  char *path = getenv("PATH");
+  if (path == NULL)
+    path = "";
+  bool stale = !trie.valid || trie.path == NULL || strcmp(trie.path, path) != 0;
+  for (size_t i = 0; i < trie.directory_count && !stale; i++)
+  {
+    struct timespec modified = completion_modified(trie.directories[i]);
+    stale = modified.tv_sec != trie.modified[i].tv_sec || modified.tv_nsec != trie.modified[i].tv_nsec;
+  }
+  if (!stale)
+    return;
+
+  completion_clear();
+  trie.count = 0;
+  completion_node_new('\0', 0);
+  trie.path = memory_strdup(MEMORY_EDITOR, path);
+  size_t directory_count = 1;
+  for (char *separator = path; (separator = strchr(separator, ':')) != NULL; separator++)
+    directory_count++;
+  trie.directories = memory_calloc(MEMORY_EDITOR, directory_count, sizeof(char *));
+  trie.modified = memory_calloc(MEMORY_EDITOR, directory_count, sizeof(struct timespec));
+  for (char *start = path;; start++)
+  {
+    char *end = strchrnul(start, ':');
+    // An empty entry is the working directory
+    char *directory = end == start ? memory_strdup(MEMORY_EDITOR, ".") : memory_strndup(MEMORY_EDITOR, start, end - start);
+    // The time is taken before scanning, a change during the scan is caught by the next refresh
+    trie.modified[trie.directory_count] = completion_modified(directory);
+    trie.directories[trie.directory_count++] = directory;
+    completion_scan(directory);
+    if (*end == '\0')
+      break;
+    start = end;
+  }
+  for (char **name = builtin_names; *name; name++)
+    completion_insert(*name);
+  trie.valid = true;
+}
+
+/**
+ * @brief Add a candidate to the list, only the first `COMPLETION_MAX_CANDIDATES` are kept.
+ */
+static void completion_list_add(completion_list *list, char *candidate, size_t length)
+{
+  list->total++;
+  if (list->count == COMPLETION_MAX_CANDIDATES)
+    return;
+  if (list->candidates == NULL)
+    list->candidates = memory_calloc(MEMORY_EDITOR, COMPLETION_MAX_CANDIDATES, sizeof(char *));
+  list->candidates[list->count++] = memory_strndup(MEMORY_EDITOR, candidate, length);
+}
+
+/**
+ * @brief Walk the subtree depth first, adding every name in order.
+ */
+static void completion_collect(uint32_t node, char *name, size_t length, completion_list *list)
+{
+  if (trie.nodes[node].terminal)
+    completion_list_add(list, name, length);
+  for (uint32_t child = trie.nodes[node].child; child != 0; child = trie.nodes[child].sibling)
+  {
+    name[length] = trie.nodes[child].character;
+    completion_collect(child, name, length + 1, list);
+  }
+}
+
+/**
+ * @brief Complete the prefix of a command with the executables in `PATH` and the built-in commands.
+ */
+void completion_commands(char *prefix, completion_list *list)
+{
+  *list = (completion_list){0};
+  completion_refresh();
+  size_t length = strlen(prefix);
+  if (length > NAME_MAX)
+    return;
+  uint32_t node = 0;
+  for (unsigned char *character = (unsigned char *)prefix; *character; character++)
+  {
+    uint32_t child = trie.nodes[node].child;
+    while (child != 0 && trie.nodes[child].character < *character)
+      child = trie.nodes[child].sibling;
+    if (child == 0 || trie.nodes[child].character != *character)
+      return;
+    node = child;
+  }
+  char name[NAME_MAX + 1];
+  memcpy(name, prefix, length);
+  // Extend the prefix as long as there is no choice to make
+  size_t common_length = length;
+  for (uint32_t common = node; !trie.nodes[common].terminal && trie.nodes[common].child != 0 &&
+                               trie.nodes[trie.nodes[common].child].sibling == 0;)
+  {
+    common = trie.nodes[common].child;
+    name[common_length++] = trie.nodes[common].character;
+  }
+  list->common = memory_strndup(MEMORY_EDITOR, name, common_length);
+  completion_collect(node, name, length, list);
+}
+
+/**
+ * @brief Compare two candidates for `qsort()`.
+ */
+static int32_t completion_compare(const void *left, const void *right)
+{
+  return strcmp(*(char **)left, *(char **)right);
+}
+
+/**
+ * @brief Complete the prefix of a path with the entries of its directory.
+ * Hidden entries are only candidates if the prefix of the name starts with a dot.
+ */
+void completion_files(char *prefix, completion_list *list)
+{
+  *list = (completion_list){0};
+  char *slash = strrchr(prefix, '/');
+  char *base = slash == NULL ? prefix : slash + 1;
+  size_t directory_length = base - prefix, base_length = strlen(base);
+  char *directory = directory_length == 0 ? memory_strdup(MEMORY_EDITOR, ".")
+                                          : memory_strndup(MEMORY_EDITOR, prefix, directory_length);
+  DIR *stream = opendir(directory);
+  memory_free(directory);
+  if (stream == NULL)
+    return;
+  char candidate[PATH_MAX];
+  size_t common_length = 0;
+  bool directory_candidate = false;
+  struct dirent *entry;
+  while ((entry = readdir(stream)) != NULL)
+  {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    if (strncmp(entry->d_name, base, base_length) != 0 || (entry->d_name[0] == '.' && base[0] != '.'))
+      continue;
+    size_t length = directory_length + strlen(entry->d_name);
+    if (length >= PATH_MAX)
+      continue;
+    memcpy(candidate, prefix, directory_length);
+    strcpy(candidate + directory_length, entry->d_name);
+    if (list->common == NULL)
+    {
+      list->common = memory_strdup(MEMORY_EDITOR, candidate);
+      common_length = length;
+    }
+    else
+      while (common_length > 0 && strncmp(list->common, candidate, common_length) != 0)
+        common_length--;
+    struct stat status;
+    directory_candidate = entry->d_type == DT_DIR ||
+                          ((entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) &&
+                           fstatat(dirfd(stream), entry->d_name, &status, 0) == 0 && S_ISDIR(status.st_mode));
+    completion_list_add(list, candidate, length);
+  }
+  closedir(stream);
+  if (list->common != NULL)
+    list->common[common_length] = '\0';
+  list->directory = list->total == 1 && directory_candidate;
+  if (list->count > 1)
+    qsort(list->candidates, list->count, sizeof(char *), completion_compare);
+}
+
+/**
+ * @brief Free the strings of the list.
+ */
+void completion_list_free(completion_list *list)
+{
+  for (size_t i = 0; i < list->count; i++)
+    memory_free(list->candidates[i]);
+  memory_free(list->candidates);
+  memory_free(list->common);
+  *list = (completion_list){0};
+}
+
+/**
+ * @brief Free the trie, the next completion builds it again.
+ */
+void completion_free()
+{
+  completion_clear();
+  memory_free(trie.nodes);
+  trie = (completion_trie){0};
+}
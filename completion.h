@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define COMPLETION_MAX_CANDIDATES 256
+#define COMPLETION_NODES_SIZE 4096
+
+typedef struct
+{
+  // The longest string every candidate starts with
+  char *common;
+  // At most `COMPLETION_MAX_CANDIDATES` candidates, sorted
+  char **candidates;
+  size_t count;
+  size_t total;
+  // The only candidate is a directory
+  bool directory;
+} completion_list;
+
+void completion_commands(char *prefix, completion_list *list);
+void completion_files(char *prefix, completion_list *list);
+void completion_list_free(completion_list *list);
+void completion_invalidate();
+void completion_free();
@@ -0,0 +1,442 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "editor.h"
+#include "completion.h"
+#include "logger.h"
+#include "memory.h"
+
+#define EDITOR_KEY_CTRL(key) ((key) & 0x1f)
+#define EDITOR_KEY_ESCAPE 27
+#define EDITOR_KEY_BACKSPACE 127
+
+/**
+ * @brief Create a line editor on the terminal, with the history of `$HISTFILE` or `~/.untitled_shell_history`.
+ * @return The editor, or `NULL` if the input is not a terminal.
+ */
+editor *editor_new(int32_t input, int32_t output)
+{
+  struct termios original;
+  if (!isatty(input) || tcgetattr(input, &original) == -1)
+    return NULL;
+  editor *new_editor = memory_calloc(MEMORY_EDITOR, 1, sizeof(editor));
+  new_editor->input = input;
+  new_editor->output = output;
+  new_editor->original = original;
+  char *path = getenv("HISTFILE");
+  char *home = getenv("HOME");
+  if (path != NULL && *path != '\0')
+    new_editor->history = history_new(path);
+  else if (home != NULL && *home != '\0')
+  {
+    char *default_path = memory_calloc(MEMORY_EDITOR, strlen(home) + strlen(HISTORY_FILE_NAME) + 2, sizeof(char));
+    sprintf(default_path, "%s/%s", home, HISTORY_FILE_NAME);
+    new_editor->history = history_new(default_path);
+    memory_free(default_path);
+  }
+  else
+    new_editor->history = history_new(NULL);
+  return new_editor;
+}
+
+/**
+ * @brief Free the editor, close its history and drop the completion trie.
+ */
+void editor_free(editor *editor)
+{
+  if (editor == NULL)
+    return;
+  history_free(editor->history);
+  completion_free();
+  memory_free(editor);
+}
+
+/**
+ * @brief Write everything, the terminal may accept less at once.
+ */
+static void editor_write(editor *editor, char *text, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t written = write(editor->output, text, length);
+    if (written == -1 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return;
+    text += written;
+    length -= written;
+  }
+}
+
+/**
+ * @brief Redraw the prompt and the line, then put the cursor back. Lines are not wrapped.
+ */
+static void editor_refresh(editor *editor)
+{
+  char buffer[EDITOR_LINE_SIZE * 2];
+  int32_t length = snprintf(buffer, sizeof(buffer), "\r%s%.*s\x1b[K\r", editor->prompt, (int32_t)editor->length,
+                            editor->line);
+  size_t column = strlen(editor->prompt) + editor->cursor;
+  if (column > 0 && length < (int32_t)sizeof(buffer))
+    length += snprintf(buffer + length, sizeof(buffer) - length, "\x1b[%zuC", column);
+  editor_write(editor, buffer, length < (int32_t)sizeof(buffer) ? length : (int32_t)sizeof(buffer) - 1);
+}
+
+/**
+ * @brief Insert the text at the cursor, as much of it as fits in the line.
+ */
+static void editor_insert(editor *editor, char *text, size_t length)
+{
+  if (editor->length + length > EDITOR_LINE_SIZE - 1)
+    length = EDITOR_LINE_SIZE - 1 - editor->length;
+  memmove(editor->line + editor->cursor + length, editor->line + editor->cursor, editor->length - editor->cursor);
+  memcpy(editor->line + editor->cursor, text, length);
+  editor->length += length;
+  editor->cursor += length;
+}
+
+/**
+ * @brief Delete `length` characters starting at `start`.
+ */
+static void editor_delete(editor *editor, size_t start, size_t length)
+{
+  memmove(editor->line + start, editor->line + start + length, editor->length - start - length);
+  editor->length -= length;
+  if (editor->cursor > start + length)
+    editor->cursor -= length;
+  else if (editor->cursor > start)
+    editor->cursor = start;
+}
+
+/**
+ * @brief Replace the line with the text, the cursor goes to its end.
+ */
+static void editor_set_line(editor *editor, char *text, size_t length)
+{
+  if (length > EDITOR_LINE_SIZE - 1)
+    length = EDITOR_LINE_SIZE - 1;
+  memmove(editor->line, text, length);
+  editor->length = length;
+  editor->cursor = length;
+}
+
+/**
+ * @brief Show an older (`-1`) or newer (`1`) entry of the history, the edited line is kept aside.
+ */
+static void editor_browse(editor *editor, int32_t direction)
+{
+  history *history = editor->history;
+  if ((direction < 0 && editor->history_index == 0) || (direction > 0 && editor->history_index >= history->count))
+    return;
+  if (editor->history_index == history->count)
+  {
+    memcpy(editor->saved, editor->line, editor->length);
+    editor->saved_length = editor->length;
+  }
+  editor->history_index += direction;
+  if (editor->history_index == history->count)
+    editor_set_line(editor, editor->saved, editor->saved_length);
+  else
+    editor_set_line(editor, history->entries[editor->history_index].text, history->entries[editor->history_index].length);
+}
+
+/**
+ * @brief Complete the word before the cursor.
+ * The first word of a command is completed with the trie of executables, other words with file names.
+ * Without progress, the candidates are listed below the line.
+ */
+static void editor_complete(editor *editor)
+{
+  size_t start = editor->cursor;
+  while (start > 0 && editor->line[start - 1] != ' ')
+    start--;
+  size_t previous = start;
+  while (previous > 0 && editor->line[previous - 1] == ' ')
+    previous--;
+  bool command = previous == 0 || strchr("|;&", editor->line[previous - 1]) != NULL;
+  char word[EDITOR_LINE_SIZE];
+  size_t word_length = editor->cursor - start;
+  memcpy(word, editor->line + start, word_length);
+  word[word_length] = '\0';
+
+  completion_list list;
+  if (command && strchr(word, '/') == NULL)
+    completion_commands(word, &list);
+  else
+    completion_files(word, &list);
+  if (list.total == 0)
+  {
+    editor_write(editor, "\a", 1);
+    completion_list_free(&list);
+    return;
+  }
+  size_t common_length = strlen(list.common);
+  if (common_length > word_length)
+    editor_insert(editor, list.common + word_length, common_length - word_length);
+  if (list.total == 1)
+    editor_insert(editor, list.directory ? "/" : " ", 1);
+  else if (common_length <= word_length)
+  {
+    editor_write(editor, "\r\n", 2);
+    for (size_t i = 0; i < list.count; i++)
+    {
+      editor_write(editor, list.candidates[i], strlen(list.candidates[i]));
+      editor_write(editor, "  ", 2);
+    }
+    if (list.total > list.count)
+      editor_write(editor, "...", 3);
+    editor_write(editor, "\r\n", 2);
+  }
+  completion_list_free(&list);
+}
+
+/**
+ * @brief Incremental reverse search in the history (`Ctrl-R`).
+ * Typing narrows the search, `Ctrl-R` again goes to an older match, `Ctrl-G` or escape gives up.
+ * Any other key puts the match in the line.
+ * @return `true` if the match was accepted with enter and the line is complete.
+ */
+static bool editor_reverse_search(editor *editor)
+{
+  history *history = editor->history;
+  char needle[EDITOR_SEARCH_SIZE] = "";
+  size_t needle_length = 0;
+  ssize_t match = -1;
+  bool failing = false;
+  while (true)
+  {
+    char buffer[EDITOR_LINE_SIZE + EDITOR_SEARCH_SIZE + 64];
+    char *text = match >= 0 ? history->entries[match].text : "";
+    int32_t text_length = match >= 0 ? history->entries[match].length : 0;
+    int32_t length = snprintf(buffer, sizeof(buffer), "\r(%sreverse-i-search)`%s': %.*s\x1b[K",
+                              failing ? "failing " : "", needle, text_length, text);
+    editor_write(editor, buffer, length < (int32_t)sizeof(buffer) ? length : (int32_t)sizeof(buffer) - 1);
+
+    char character;
+    ssize_t result = read(editor->input, &character, 1);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result <= 0)
+      return false;
+    ssize_t found = -1;
+    if (character == EDITOR_KEY_CTRL('R'))
+    {
+      if (needle_length == 0)
+        continue;
+      found = history_search(history, needle, match >= 0 ? match : history->count);
+    }
+    else if (character == EDITOR_KEY_BACKSPACE || character == EDITOR_KEY_CTRL('H'))
+    {
+      if (needle_length == 0)
+        continue;
+      needle[--needle_length] = '\0';
+      found = needle_length == 0 ? -1 : history_search(history, needle, history->count);
+      if (needle_length == 0)
+        match = -1;
+    }
+    else if (isprint((unsigned char)character))
+    {
+      if (needle_length == EDITOR_SEARCH_SIZE - 1)
+        continue;
+      needle[needle_length++] = character;
+      needle[needle_length] = '\0';
+      // The current match may still contain the longer needle, if the shorter one never matched nothing contains it
+      found = failing && match < 0 ? -1 : history_search(history, needle, match >= 0 ? match + 1 : history->count);
+    }
+    else
+    {
+      if (character != EDITOR_KEY_CTRL('G') && character != EDITOR_KEY_ESCAPE && match >= 0)
+      {
+        editor_set_line(editor, history->entries[match].text, history->entries[match].length);
+        editor->history_index = match;
+      }
+      return character == '\r' || character == '\n';
+    }
+    failing = needle_length > 0 && found < 0;
+    if (found >= 0)
+      match = found;
+  }
+}
+
+/**
+ * @brief Read the rest of an escape sequence and handle the arrows, home, end and delete keys.
+ */
+static void editor_escape(editor *editor)
+{
+  char sequence[3];
+  if (read(editor->input, &sequence[0], 1) != 1 || read(editor->input, &sequence[1], 1) != 1)
+    return;
+  if (sequence[0] == '[' && sequence[1] >= '0' && sequence[1] <= '9')
+  {
+    if (read(editor->input, &sequence[2], 1) != 1 || sequence[2] != '~')
+      return;
+    if (sequence[1] == '3' && editor->cursor < editor->length)
+      editor_delete(editor, editor->cursor, 1);
+    else if (sequence[1] == '1' || sequence[1] == '7')
+      editor->cursor = 0;
+    else if (sequence[1] == '4' || sequence[1] == '8')
+      editor->cursor = editor->length;
+    return;
+  }
+  if (sequence[0] != '[' && sequence[0] != 'O')
+    return;
+  switch (sequence[1])
+  {
+  case 'A':
+    editor_browse(editor, -1);
+    break;
+  case 'B':
+    editor_browse(editor, 1);
+    break;
+  case 'C':
+    if (editor->cursor < editor->length)
+      editor->cursor++;
+    break;
+  case 'D':
+    if (editor->cursor > 0)
+      editor->cursor--;
+    break;
+  case 'H':
+    editor->cursor = 0;
+    break;
+  case 'F':
+    editor->cursor = editor->length;
+    break;
+  }
+}
+
+/**
+ * @brief Handle a key.
+ * @return `1` if the line is complete, `-1` at the end of input, `0` otherwise.
+ */
+static int32_t editor_key(editor *editor, char character)
+{
+  switch (character)
+  {
+  case '\r':
+  case '\n':
+    return 1;
+  case EDITOR_KEY_CTRL('D'):
+    if (editor->length == 0)
+      return -1;
+    if (editor->cursor < editor->length)
+      editor_delete(editor, editor->cursor, 1);
+    break;
+  case EDITOR_KEY_CTRL('C'):
+    editor_write(editor, "^C\r\n", 4);
+    editor->length = editor->cursor = 0;
+    editor->history_index = editor->history->count;
+    break;
+  case EDITOR_KEY_BACKSPACE:
+  case EDITOR_KEY_CTRL('H'):
+    if (editor->cursor > 0)
+      editor_delete(editor, editor->cursor - 1, 1);
+    break;
+  case EDITOR_KEY_CTRL('A'):
+    editor->cursor = 0;
+    break;
+  case EDITOR_KEY_CTRL('E'):
+    editor->cursor = editor->length;
+    break;
+  case EDITOR_KEY_CTRL('B'):
+    if (editor->cursor > 0)
+      editor->cursor--;
+    break;
+  case EDITOR_KEY_CTRL('F'):
+    if (editor->cursor < editor->length)
+      editor->cursor++;
+    break;
+  case EDITOR_KEY_CTRL('K'):
+    editor->length = editor->cursor;
+    break;
+  case EDITOR_KEY_CTRL('U'):
+    editor_delete(editor, 0, editor->cursor);
+    break;
+  case EDITOR_KEY_CTRL('W'):
+  {
+    size_t start = editor->cursor;
+    while (start > 0 && editor->line[start - 1] == ' ')
+      start--;
+    while (start > 0 && editor->line[start - 1] != ' ')
+      start--;
+    editor_delete(editor, start, editor->cursor - start);
+    break;
+  }
+  case EDITOR_KEY_CTRL('L'):
+    editor_write(editor, "\x1b[H\x1b[2J", 7);
+    break;
+  case EDITOR_KEY_CTRL('P'):
+    editor_browse(editor, -1);
+    break;
+  case EDITOR_KEY_CTRL('N'):
+    editor_browse(editor, 1);
+    break;
+  case EDITOR_KEY_CTRL('R'):
+    if (editor_reverse_search(editor))
+      return 1;
+    break;
+  case '\t':
+    editor_complete(editor);
+    break;
+  case EDITOR_KEY_ESCAPE:
+    editor_escape(editor);
+    break;
+  default:
+    if (isprint((unsigned char)character))
+      editor_insert(editor, &character, 1);
+    break;
+  }
+  return 0;
+}
+
+/**
+ * @brief Read a line from the terminal in raw mode, with editing, history and completion.
+ * The terminal is restored before returning, commands run with the terminal as they expect it.
+ * @param length Set to the length of the line.
+ * @return The line without newline, owned by the editor and valid until the next call. `NULL` at the end of input.
+ */
+char *editor_read_line(editor *editor, char *prompt, size_t *length)
+{
+  struct termios raw = editor->original;
+  raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+  raw.c_oflag &= ~(OPOST);
+  raw.c_cflag |= CS8;
+  raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+  if (tcsetattr(editor->input, TCSADRAIN, &raw) == -1)
+  {
+    logger(LOG_WARNING, "Failed to set the terminal to raw mode.\n");
+    return NULL;
+  }
+  editor->prompt = prompt;
+  editor->length = editor->cursor = 0;
+  editor->history_index = editor->history->count;
+  int32_t state = 0;
+  while (state == 0)
+  {
+    editor_refresh(editor);
+    char character;
+    ssize_t result = read(editor->input, &character, 1);
+    if (result == -1 && errno == EINTR)
+      continue;
+    state = result <= 0 ? -1 : editor_key(editor, character);
+  }
+  editor->cursor = editor->length;
+  editor_refresh(editor);
+  editor_write(editor, "\r\n", 2);
+  tcsetattr(editor->input, TCSADRAIN, &editor->original);
+  if (state == -1)
+    return NULL;
+  editor->line[editor->length] = '\0';
+  *length = editor->length;
+  return editor->line;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <termios.h>
+
+#include "history.h"
+
+#define EDITOR_LINE_SIZE 4096
+#define EDITOR_SEARCH_SIZE 256
+
+typedef struct
+{
+  int32_t input;
+  int32_t output;
+  struct termios original;
+  char *prompt;
+  char line[EDITOR_LINE_SIZE];
+  size_t length;
+  size_t cursor;
+  history *history;
+  // The entry shown while browsing the history, `history->count` for the line being edited
+  size_t history_index;
+  char saved[EDITOR_LINE_SIZE];
+  size_t saved_length;
+} editor;
+
+editor *editor_new(int32_t input, int32_t output);
+char *editor_read_line(editor *editor, char *prompt, size_t *length);
+void editor_free(editor *editor);
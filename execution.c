@@ -9,10 +9,184 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "ast.h"
 #include "logger.h"
 #include "bulitins.h"
+#include "memory.h"
+#include "execution.h"
+#include "supervisor.h"
+
+typedef struct
+{
+  AST *ast;
+  int32_t input;
+  int32_t output;
+  bool threaded;
+  pthread_t thread;
+  pid_t pid;
+  size_t child;
+  int32_t status;
+} execution_stage;
+
+/**
+ * @brief `fork()` with the signal mask restored in the child.
+ * Builtin threads block `SIGPIPE`, the commands they start MUST NOT inherit it.
+ */
+pid_t execution_fork()
+{
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigprocmask(SIG_SETMASK, &signals, NULL);
+  }
+  return pid;
+}
+
+/**
+ * @brief Build the null-terminated argument vector of the command.
+ * The strings are owned by the AST, only the vector has to be freed.
+ */
+static char **execution_arguments(struct AST_COMMAND command)
+{
+  char **arguments = memory_calloc(MEMORY_EXECUTOR, command.argc + 1, sizeof(char *));
+  arguments[0] = command.executable;
+  if (command.argc > 1)
+    for (size_t i = 1; i <= command.argc - 1; i++)
+    {
+      struct AST_ARGUMENT argument = command.arguments[i]->data.AST_ARGUMENT;
+      arguments[i] = argument.value;
+    }
+  arguments[command.argc] = NULL;
+  return arguments;
+}
+
+/**
+ * @brief Run a builtin pipeline stage on its own end of the pipes.
+ * `SIGPIPE` is blocked on this thread, a closed reader results in `EPIPE` instead of killing the shell.
+ */
+static void *execution_stage_thread(void *argument)
+{
+  execution_stage *stage = argument;
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  FILE *input = stage->input == STDIN_FILENO ? stdin : fdopen(stage->input, "r");
+  FILE *output = stage->output == STDOUT_FILENO ? stdout : fdopen(stage->output, "w");
+  struct AST_COMMAND command = stage->ast->data.AST_COMMAND;
+  char **arguments = execution_arguments(command);
+  stage->status = run_builtin(command.argc, arguments, input, output);
+  memory_free(arguments);
+  if (input != stdin)
+    fclose(input);
+  if (output != stdout)
+    fclose(output);
+  else
+    fflush(stdout);
+  return NULL;
+}
+
+/**
+ * @brief Execute the pipeline `stage | stage | ...` made of nested `AST_PIPE`.
+ * Builtins which are safe to run on a thread stay in the shell process, only the other stages are forked.
+ * @return The exit status of every stage OR-ed together.
+ */
+static int32_t execution_pipeline(AST *ast)
+{
+  size_t count = 1;
+  for (AST *node = ast; node != NULL && node->tag == AST_PIPE; node = node->data.AST_PIPE.right)
+    count++;
+  execution_stage *stages = memory_calloc(MEMORY_EXECUTOR, count, sizeof(execution_stage));
+  AST *node = ast;
+  for (size_t i = 0; i <= count - 1; i++)
+  {
+    stages[i].ast = i == count - 1 ? node : node->data.AST_PIPE.left;
+    if (i != count - 1)
+      node = node->data.AST_PIPE.right;
+    stages[i].threaded = stages[i].ast != NULL && stages[i].ast->tag == AST_COMMAND &&
+                         scan_threaded_builtin(stages[i].ast->data.AST_COMMAND.executable);
+    stages[i].input = STDIN_FILENO;
+    stages[i].output = STDOUT_FILENO;
+  }
+  for (size_t i = 0; i <= count - 2; i++)
+  {
+    // Close-on-exec, the commands only keep the ends duplicated to their standard streams
+    int32_t pipe_between_stages[2];
+    if (pipe2(pipe_between_stages, O_CLOEXEC) == -1)
+      logger(LOG_ERROR, "Failed to create pipe.\n");
+    stages[i].output = pipe_between_stages[1];
+    stages[i + 1].input = pipe_between_stages[0];
+  }
+
+  fflush(stdout);
+  supervisor *children = supervisor_new();
+  for (size_t i = 0; i <= count - 1; i++)
+  {
+    execution_stage *stage = &stages[i];
+    if (stage->threaded)
+    {
+      if (pthread_create(&stage->thread, NULL, execution_stage_thread, stage) == 0)
+        continue;
+      logger(LOG_WARNING, "Failed to create thread, forking instead.\n");
+      stage->threaded = false;
+    }
+    stage->pid = execution_fork();
+    if (stage->pid == -1)
+      logger(LOG_ERROR, "Failed to fork pipeline stage.\n");
+    if (stage->pid == 0)
+    {
+      if (stage->input != STDIN_FILENO)
+        dup2(stage->input, STDIN_FILENO);
+      if (stage->output != STDOUT_FILENO)
+        dup2(stage->output, STDOUT_FILENO);
+      // Drop every other end, otherwise the readers never see the end of file
+      for (size_t j = 0; j <= count - 1; j++)
+      {
+        if (stages[j].input != STDIN_FILENO)
+          close(stages[j].input);
+        if (stages[j].output != STDOUT_FILENO)
+          close(stages[j].output);
+      }
+      exit(execution(stage->ast, true, true));
+    }
+    if (stage->pid > 0)
+      stage->child = supervisor_add(children, stage->pid);
+  }
+  // The threads close their own ends
+  for (size_t i = 0; i <= count - 1; i++)
+  {
+    if (stages[i].threaded)
+      continue;
+    if (stages[i].input != STDIN_FILENO)
+      close(stages[i].input);
+    if (stages[i].output != STDOUT_FILENO)
+      close(stages[i].output);
+  }
+
+  // The forked stages are reaped in the order they finish, then the threads are joined
+  supervisor_wait_all(children);
+  int32_t result = 0;
+  for (size_t i = 0; i <= count - 1; i++)
+  {
+    if (stages[i].threaded)
+    {
+      pthread_join(stages[i].thread, NULL);
+      result |= stages[i].status;
+    }
+    else if (stages[i].pid > 0)
+      result |= supervisor_status(children, stages[i].child);
+    else
+      result |= EXIT_FAILURE;
+  }
+  supervisor_free(children);
+  memory_free(stages);
+  return result;
+}
 
 int32_t execution(AST *ast, bool forked, bool parallel)
 {
@@ -26,18 +200,14 @@ int32_t execution(AST *ast, bool forked, bool parallel)
     struct AST_COMMAND command = ast_value.data.AST_COMMAND;
     if (command.argc == 0)
       logger(LOG_ERROR, "No command provided.\n");
-    char **arguments = calloc(sizeof(char *) * (command.argc + 1), sizeof(char *));
-    arguments[0] = command.executable;
-    if (command.argc > 1)
-      for (size_t i = 1; i <= command.argc - 1; i++)
-      {
-        struct AST_ARGUMENT argument = command.arguments[i]->data.AST_ARGUMENT;
-        arguments[i] = argument.value;
-      }
-    arguments[command.argc] = NULL;
+    char **arguments = execution_arguments(command);
     // Because of the spec, our builtins are preferred over system commands
     if (scan_builtin(command.executable))
-      return run_builtin(command.argc, arguments);
+    {
+      int32_t result = run_builtin(command.argc, arguments, stdin, stdout);
+      memory_free(arguments);
+      return result;
+    }
     if (forked)
     {
       {
@@ -50,7 +220,7 @@ int32_t execution(AST *ast, bool forked, bool parallel)
     }
     else
     {
-      pid_t pid = fork();
+      pid_t pid = execution_fork();
       if (pid == -1)
         logger(LOG_ERROR, "Failed to fork.\n");
       if (pid == 0)
@@ -60,8 +230,11 @@ int32_t execution(AST *ast, bool forked, bool parallel)
           logger(LOG_WARNING, "Failed to execute command.\n");
         exit(result);
       }
+      memory_free(arguments);
+      if (parallel || pid == -1)
+        return pid == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
+      return supervisor_wait_one(pid);
     }
-    return EXIT_SUCCESS;
     break;
   }
   case AST_ARGUMENT:
@@ -70,7 +243,7 @@ int32_t execution(AST *ast, bool forked, bool parallel)
   case AST_REDIRECTION:
   {
     struct AST_REDIRECTION redirection = ast_value.data.AST_REDIRECTION;
-    pid_t pid = fork();
+    pid_t pid = execution_fork();
     if (pid == -1)
       logger(LOG_ERROR, "Failed to fork.\n");
     if (pid == 0)
@@ -100,75 +273,52 @@ int32_t execution(AST *ast, bool forked, bool parallel)
         logger(LOG_ERROR, "Failed to duplicate file descriptor\n");
       exit(execution(redirection.command, true, true));
     }
-    int32_t status = 0;
-    waitpid(pid, &status, 0);
-    return WEXITSTATUS(status);
+    if (pid == -1)
+      return EXIT_FAILURE;
+    return supervisor_wait_one(pid);
     break;
   }
     logger(LOG_ERROR, "Redirection not implemented\n");
     break;
   case AST_PIPE:
-  {
-    pid_t left_pid = fork(), right_pid = -1;
-    int32_t left_status = 0, right_status = 0;
-    int32_t pipe_between_process[2];
-    pipe(pipe_between_process);
-    if (left_pid == -1)
-      logger(LOG_ERROR, "Failed to fork left leaf.\n");
-    if (left_pid == 0)
-    {
-      dup2(pipe_between_process[1], STDOUT_FILENO);
-      close(pipe_between_process[0]);
-      exit(execution(ast_value.data.AST_PIPE.left, 0, true));
-    }
-    right_pid = fork();
-    if (right_pid == -1)
-      logger(LOG_ERROR, "Failed to fork right leaf.\n");
-    if (right_pid == 0)
-    {
-      dup2(pipe_between_process[0], STDIN_FILENO);
-      close(pipe_between_process[1]);
-      exit(execution(ast_value.data.AST_PIPE.right, 0, true));
-    }
-
-    close(pipe_between_process[0]);
-    close(pipe_between_process[1]);
-    waitpid(left_pid, &left_status, 0);
-    waitpid(right_pid, &right_status, 0);
-
-    return WEXITSTATUS(left_status) | WEXITSTATUS(right_status);
-    break;
-  }
+    return execution_pipeline(ast);
   case AST_LIST:
   {
     struct AST_LIST list = ast_value.data.AST_LIST;
+    supervisor *children = supervisor_new();
     // Left leaf
-    pid_t left_pid = fork(), right_pid = -1;
+    pid_t left_pid = execution_fork(), right_pid = -1;
     int32_t left_status = 0, right_status = 0;
     if (left_pid == -1)
       logger(LOG_ERROR, "Failed to fork left leaf.\n");
     if (left_pid == 0)
-      exit(execution(list.left, 0, true));
+      exit(execution(list.left, true, true));
+    size_t left_child = supervisor_add(children, left_pid);
     if (!(list.AST_LIST_TYPE == AST_LIST_PARALLEL))
-      waitpid(left_pid, &left_status, 0);
+    {
+      supervisor_wait_any(children, -1);
+      left_status = supervisor_status(children, left_child);
+    }
     // Right leaf
     // If the left leaf successes and the list is OR, don't execute the right leaf
     // If the left leaf fails and the list is AND, don't execute the right leaf
-    if (!((WEXITSTATUS(left_status) == EXIT_SUCCESS && list.AST_LIST_TYPE == AST_LIST_OR) ||
-          (WEXITSTATUS(left_status) != EXIT_SUCCESS && list.AST_LIST_TYPE == AST_LIST_AND)))
+    if (!((left_status == EXIT_SUCCESS && list.AST_LIST_TYPE == AST_LIST_OR) ||
+          (left_status != EXIT_SUCCESS && list.AST_LIST_TYPE == AST_LIST_AND)))
     {
-      right_pid = fork();
+      right_pid = execution_fork();
       if (right_pid == -1)
         logger(LOG_ERROR, "Failed to fork right leaf.\n");
       if (right_pid == 0)
-        exit(execution(list.right, 0, true));
+        exit(execution(list.right, true, true));
+      size_t right_child = supervisor_add(children, right_pid);
+      supervisor_wait_all(children);
+      right_status = supervisor_status(children, right_child);
     }
-    if (list.AST_LIST_TYPE == AST_LIST_PARALLEL)
-      waitpid(left_pid, &left_status, 0);
-    else
-      waitpid(right_pid, &right_status, 0);
+    supervisor_wait_all(children);
+    left_status = supervisor_status(children, left_child);
+    supervisor_free(children);
 
-    return WEXITSTATUS(left_status) | WEXITSTATUS(right_status);
+    return left_status | right_status;
     break;
   }
   case AST_FD:
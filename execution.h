@@ -2,7 +2,9 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/types.h>
 
 #include "ast.h"
 
-int32_t execution(AST *ast, pid_t forked, bool wait);
\ No newline at end of file
+int32_t execution(AST *ast, bool forked, bool parallel);
+pid_t execution_fork();
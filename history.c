@@ -0,0 +1,247 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "history.h"
+#include "logger.h"
+#include "memory.h"
+
+/**
+ * @brief Set the bit of the key, taken from the top bits of a multiplicative hash.
+ */
+static void history_signature_set(uint64_t *signature, uint32_t key)
+{
+  uint32_t bit = key * 2654435761u >> 24;
+  signature[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+/**
+ * @brief Set the bit of every pair and triple of adjacent characters of the text.
+ */
+static void history_signature(char *text, size_t length, uint64_t *signature)
+{
+  memset(signature, 0, HISTORY_SIGNATURE_BITS / 8);
+  uint32_t window = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    window = (window << 8 | (unsigned char)text[i]) & 0xffffff;
+    if (i >= 1)
+      history_signature_set(signature, window & 0xffff);
+    // The high bit keeps a triple from hashing like the pair it ends with
+    if (i >= 2)
+      history_signature_set(signature, window | 1u << 24);
+  }
+}
+
+/**
+ * @brief The posting list of the key, taken from the top bits of a multiplicative hash.
+ */
+static history_postings *history_get_postings(history *history, uint32_t key)
+{
+  return &history->postings[key * 2654435761u >> 20];
+}
+
+/**
+ * @brief Record that the block holds the key, once per block.
+ */
+static void history_post(history *history, uint32_t key, uint32_t block)
+{
+  history_postings *postings = history_get_postings(history, key);
+  if (postings->count > 0 && postings->blocks[postings->count - 1] == block)
+    return;
+  if (postings->count == postings->capacity)
+  {
+    postings->capacity = postings->capacity == 0 ? 16 : postings->capacity * 2;
+    postings->blocks = memory_realloc(MEMORY_EDITOR, postings->blocks, postings->capacity * sizeof(uint32_t));
+  }
+  postings->blocks[postings->count++] = block;
+}
+
+/**
+ * @brief Append an entry to the index.
+ */
+static void history_index(history *history, char *text, size_t length)
+{
+  if (history->count == history->capacity)
+  {
+    history->capacity = history->capacity == 0 ? HISTORY_ENTRIES_SIZE : history->capacity * 2;
+    history->entries = memory_realloc(MEMORY_EDITOR, history->entries, history->capacity * sizeof(history_entry));
+  }
+  history_entry *entry = &history->entries[history->count++];
+  entry->text = text;
+  entry->length = length;
+  history_signature(text, length, entry->signature);
+  uint32_t block = (history->count - 1) / HISTORY_BLOCK_SIZE, window = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    window = (window << 8 | (unsigned char)text[i]) & 0xffff;
+    // The high bit keeps a character from hashing like a pair
+    history_post(history, (unsigned char)text[i] | 1u << 24, block);
+    if (i >= 1)
+      history_post(history, window, block);
+  }
+}
+
+/**
+ * @brief Load the history file, creating it if needed, and index its entries.
+ * @param path The history file, `NULL` to keep the history in memory only.
+ */
+history *history_new(char *path)
+{
+  history *new_history = memory_calloc(MEMORY_EDITOR, 1, sizeof(history));
+  new_history->file_descriptor = -1;
+  new_history->postings = memory_calloc(MEMORY_EDITOR, HISTORY_BUCKETS, sizeof(history_postings));
+  if (path == NULL)
+    return new_history;
+  new_history->file_descriptor = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+  if (new_history->file_descriptor == -1)
+  {
+    logger(LOG_WARNING, "Failed to open the history file.\n");
+    return new_history;
+  }
+  struct stat status;
+  if (fstat(new_history->file_descriptor, &status) == -1 || status.st_size == 0)
+    return new_history;
+  char *mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, new_history->file_descriptor, 0);
+  if (mapping == MAP_FAILED)
+  {
+    logger(LOG_WARNING, "Failed to map the history file.\n");
+    return new_history;
+  }
+  new_history->mapping = mapping;
+  new_history->mapping_length = status.st_size;
+  char *end = mapping + status.st_size;
+  for (char *line = mapping; line < end;)
+  {
+    char *newline = memchr(line, '\n', end - line);
+    if (newline == NULL)
+      newline = end;
+    if (newline != line)
+      history_index(new_history, line, newline - line);
+    line = newline + 1;
+  }
+  new_history->mapped_count = new_history->count;
+  return new_history;
+}
+
+/**
+ * @brief Add the line to the history and append it to the history file.
+ * Empty lines and repetitions of the last entry are ignored.
+ */
+void history_add(history *history, char *line, size_t length)
+{
+  if (length == 0 || memchr(line, '\n', length) != NULL)
+    return;
+  if (history->count > 0 && history->entries[history->count - 1].length == length &&
+      memcmp(history->entries[history->count - 1].text, line, length) == 0)
+    return;
+  char *text = memory_strndup(MEMORY_EDITOR, line, length);
+  history_index(history, text, length);
+  if (history->file_descriptor == -1)
+    return;
+  // A single `write()` of the whole line, `O_APPEND` keeps concurrent shells from interleaving
+  text[length] = '\n';
+  if (write(history->file_descriptor, text, length + 1) != (ssize_t)length + 1)
+    logger(LOG_WARNING, "Failed to append to the history file.\n");
+  text[length] = '\0';
+}
+
+/**
+ * @brief Find the newest entry older than `before` containing the needle.
+ * Only the blocks found in the posting lists of every character (for a single character needle)
+ * or pair of adjacent characters of the needle are visited, walking the lists from their end together.
+ * In those, an entry is only searched if its signature holds every bit of the signature of the needle.
+ * @return The index of the entry, `-1` if none matches.
+ */
+ssize_t history_search(history *history, char *needle, size_t before)
+{
+  size_t needle_length = strlen(needle);
+  if (before > history->count)
+    before = history->count;
+  if (before == 0)
+    return -1;
+  if (needle_length == 0)
+    return before - 1;
+  uint32_t last_block = (before - 1) / HISTORY_BLOCK_SIZE, next = last_block + 1;
+  history_postings *lists[HISTORY_SEARCH_KEYS];
+  size_t cursors[HISTORY_SEARCH_KEYS], count = 0, shortest = 0;
+  for (size_t i = needle_length == 1 ? 0 : 1; i < needle_length && count < HISTORY_SEARCH_KEYS; i++)
+  {
+    uint32_t key = needle_length == 1 ? (unsigned char)needle[0] | 1u << 24
+                                      : (unsigned char)needle[i - 1] << 8 | (unsigned char)needle[i];
+    history_postings *postings = history_get_postings(history, key);
+    size_t cursor = postings->count;
+    while (cursor > 0 && postings->blocks[cursor - 1] > last_block)
+      cursor--;
+    // The cursor is past the next block to look at
+    if (cursor == 0)
+      return -1;
+    // A list holding every block selects nothing, only walking it would cost
+    if (cursor == last_block + 1)
+      continue;
+    lists[count] = postings;
+    cursors[count] = cursor;
+    if (cursor < cursors[shortest])
+      shortest = count;
+    count++;
+  }
+  uint64_t signature[HISTORY_SIGNATURE_BITS / 64];
+  history_signature(needle, needle_length, signature);
+  // Without a list every block is visited
+  while (count == 0 ? next > 0 : cursors[shortest] > 0)
+  {
+    uint32_t block = count == 0 ? --next : lists[shortest]->blocks[--cursors[shortest]];
+    bool candidate = true;
+    for (size_t k = 0; k < count && candidate; k++)
+    {
+      if (k == shortest)
+        continue;
+      while (cursors[k] > 0 && lists[k]->blocks[cursors[k] - 1] > block)
+        cursors[k]--;
+      if (cursors[k] == 0)
+        return -1;
+      candidate = lists[k]->blocks[cursors[k] - 1] == block;
+    }
+    if (!candidate)
+      continue;
+    size_t first = (size_t)block * HISTORY_BLOCK_SIZE;
+    size_t end = first + HISTORY_BLOCK_SIZE < before ? first + HISTORY_BLOCK_SIZE : before;
+    for (size_t i = end; i > first; i--)
+    {
+      history_entry *entry = &history->entries[i - 1];
+      uint64_t missing = 0;
+      for (size_t word = 0; word < HISTORY_SIGNATURE_BITS / 64; word++)
+        missing |= signature[word] & ~entry->signature[word];
+      if (missing == 0 && memmem(entry->text, entry->length, needle, needle_length) != NULL)
+        return i - 1;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Free the history, unmap and close the history file.
+ */
+void history_free(history *history)
+{
+  if (history == NULL)
+    return;
+  for (size_t i = history->mapped_count; i < history->count; i++)
+    memory_free(history->entries[i].text);
+  memory_free(history->entries);
+  for (size_t i = 0; i < HISTORY_BUCKETS; i++)
+    memory_free(history->postings[i].blocks);
+  memory_free(history->postings);
+  if (history->mapping != NULL)
+    munmap(history->mapping, history->mapping_length);
+  if (history->file_descriptor != -1)
+    close(history->file_descriptor);
+  memory_free(history);
+}
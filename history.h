@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define HISTORY_FILE_NAME ".untitled_shell_history"
+#define HISTORY_ENTRIES_SIZE 1024
+// Bits of the signature of an entry, the hash gives 8 bits
+#define HISTORY_SIGNATURE_BITS 256
+// Entries sharing a posting, and the number of posting lists, the hash gives 12 bits
+#define HISTORY_BLOCK_SIZE 64
+#define HISTORY_BUCKETS 4096
+// Characters of the needle used to pick the blocks to search, the rest is only compared
+#define HISTORY_SEARCH_KEYS 32
+
+typedef struct
+{
+  char *text;
+  size_t length;
+  // A bit for every pair and triple of adjacent characters of the text (hashed), for the reverse search to skip entries
+  uint64_t signature[HISTORY_SIGNATURE_BITS / 64];
+} history_entry;
+
+// The blocks holding a character or pair of adjacent characters hashing to the bucket, in increasing order
+typedef struct
+{
+  uint32_t *blocks;
+  uint32_t count;
+  uint32_t capacity;
+} history_postings;
+
+/**
+ * The history file holds one entry per line, new entries are appended to it as they are added.
+ * The file is mapped when loaded: the entries of earlier sessions point into the mapping,
+ * the entries of this session are allocated.
+ */
+typedef struct
+{
+  int32_t file_descriptor;
+  char *mapping;
+  size_t mapping_length;
+  history_entry *entries;
+  size_t count;
+  size_t capacity;
+  // Entries below this index are in the mapping
+  size_t mapped_count;
+  history_postings *postings;
+} history;
+
+history *history_new(char *path);
+void history_add(history *history, char *line, size_t length);
+ssize_t history_search(history *history, char *needle, size_t before);
+void history_free(history *history);
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "input.h"
+#include "logger.h"
+#include "memory.h"
+#include "main.h"
+
+/**
+ * @brief Create a reader on the file descriptor.
+ * @param interactive Print the prompts before blocking on the file descriptor, and edit lines if it is a terminal.
+ */
+input_reader *input_new(int32_t file_descriptor, bool interactive)
+{
+  input_reader *reader = memory_calloc(MEMORY_INPUT, 1, sizeof(input_reader));
+  reader->file_descriptor = file_descriptor;
+  reader->interactive = interactive;
+  reader->editor = interactive ? editor_new(file_descriptor, STDOUT_FILENO) : NULL;
+  reader->buffer = memory_malloc(MEMORY_INPUT, INPUT_BUFFER_SIZE);
+  reader->command_capacity = INPUT_COMMAND_SIZE;
+  reader->command = memory_malloc(MEMORY_INPUT, reader->command_capacity);
+  return reader;
+}
+
+/**
+ * @brief Free the reader and its buffers. The file descriptor is left open.
+ */
+void input_free(input_reader *reader)
+{
+  if (reader == NULL)
+    return;
+  editor_free(reader->editor);
+  memory_free(reader->buffer);
+  memory_free(reader->command);
+  memory_free(reader);
+}
+
+/**
+ * @brief Refill the buffer with a single `read()`, or a line of the editor.
+ * @return `false` if nothing could be read anymore.
+ */
+static bool input_fill(input_reader *reader)
+{
+  if (reader->end_of_file)
+    return false;
+  char *prompt = reader->command_length == 0 ? PROGRAM_NAME " $ " : "> ";
+  if (reader->editor != NULL)
+  {
+    size_t length;
+    char *line = editor_read_line(reader->editor, prompt, &length);
+    if (line == NULL)
+    {
+      reader->end_of_file = true;
+      return false;
+    }
+    memcpy(reader->buffer, line, length);
+    reader->buffer[length] = '\n';
+    reader->buffer_start = 0;
+    reader->buffer_end = length + 1;
+    return true;
+  }
+  if (reader->interactive)
+  {
+    printf("%s", prompt);
+    fflush(stdout);
+  }
+  ssize_t result;
+  do
+    result = read(reader->file_descriptor, reader->buffer, INPUT_BUFFER_SIZE);
+  while (result == -1 && errno == EINTR);
+  if (result == -1)
+    logger(LOG_WARNING, "Failed to read input.\n");
+  if (result <= 0)
+  {
+    reader->end_of_file = true;
+    return false;
+  }
+  reader->buffer_start = 0;
+  reader->buffer_end = result;
+  return true;
+}
+
+/**
+ * @brief Append a character to the pending command, growing the command buffer if needed.
+ */
+static void input_append(input_reader *reader, char character)
+{
+  if (reader->command_length + 1 >= reader->command_capacity)
+  {
+    reader->command_capacity *= 2;
+    reader->command = memory_realloc(MEMORY_INPUT, reader->command, reader->command_capacity);
+  }
+  reader->command[reader->command_length++] = character;
+}
+
+/**
+ * @brief Check if the pending command ends with an operator that expects another command (`|`, `||` or `&&`).
+ */
+static bool input_expects_more(input_reader *reader)
+{
+  size_t end = reader->command_length;
+  while (end > 0 && (reader->command[end - 1] == ' ' || reader->command[end - 1] == '\t'))
+    end--;
+  if (end >= 1 && reader->command[end - 1] == '|')
+    return true;
+  if (end >= 2 && reader->command[end - 1] == '&' && reader->command[end - 2] == '&')
+    return true;
+  return false;
+}
+
+/**
+ * @brief Read the next logical command.
+ * Backslash-newline pairs are removed, and a newline inside quotes or after `|`, `||` or `&&` does not end the command.
+ * @return The null-terminated command without the trailing newline, owned by the reader and valid until the next call.
+ * `NULL` if the input is exhausted.
+ */
+char *input_read_command(input_reader *reader)
+{
+  // Give the memory of an exceptionally long command back
+  if (reader->command_capacity > INPUT_COMMAND_SHRINK_SIZE)
+  {
+    reader->command_capacity = INPUT_COMMAND_SIZE;
+    reader->command = memory_realloc(MEMORY_INPUT, reader->command, reader->command_capacity);
+  }
+  reader->command_length = 0;
+  char quote = '\0';
+  bool escaped = false;
+  while (true)
+  {
+    if (reader->buffer_start == reader->buffer_end && !input_fill(reader))
+    {
+      if (reader->command_length == 0)
+        return NULL;
+      if (quote == '\0')
+        break;
+      // The parser expects the closing quote, drop the command
+      logger(LOG_WARNING, "Unterminated quote at the end of input.\n");
+      reader->command_length = 0;
+      return NULL;
+    }
+    char *start = reader->buffer + reader->buffer_start;
+    char *end = reader->buffer + reader->buffer_end;
+    // Fast path: copy everything up to the next special character at once
+    if (!escaped && quote == '\0')
+    {
+      char *special = start;
+      while (special < end && *special != '\n' && *special != '\\' && *special != '"' && *special != '\'')
+        special++;
+      size_t length = special - start;
+      while (reader->command_length + length + 1 >= reader->command_capacity)
+      {
+        reader->command_capacity *= 2;
+        reader->command = memory_realloc(MEMORY_INPUT, reader->command, reader->command_capacity);
+      }
+      memcpy(reader->command + reader->command_length, start, length);
+      reader->command_length += length;
+      reader->buffer_start += length;
+      if (special == end)
+        continue;
+    }
+    char character = reader->buffer[reader->buffer_start++];
+    if (escaped)
+    {
+      escaped = false;
+      // Line continuation, drop the backslash
+      if (character == '\n')
+        reader->command_length--;
+      else
+        input_append(reader, character);
+      continue;
+    }
+    if (quote != '\0')
+    {
+      if (character == quote)
+        quote = '\0';
+      else if (character == '\\' && quote == '"')
+        escaped = true;
+      input_append(reader, character);
+      continue;
+    }
+    if (character == '\\')
+      escaped = true;
+    else if (character == '"' || character == '\'')
+      quote = character;
+    else if (character == '\n')
+    {
+      if (!input_expects_more(reader))
+        break;
+      character = ' ';
+    }
+    input_append(reader, character);
+  }
+  reader->command[reader->command_length] = '\0';
+  // The whole command, not the lines it was typed on
+  if (reader->editor != NULL)
+    history_add(reader->editor->history, reader->command, reader->command_length);
+  return reader->command;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "editor.h"
+
+#define INPUT_BUFFER_SIZE (64 * 1024)
+#define INPUT_COMMAND_SIZE 256
+#define INPUT_COMMAND_SHRINK_SIZE (1024 * 1024)
+
+typedef struct
+{
+  int32_t file_descriptor;
+  bool interactive;
+  bool end_of_file;
+  // Line editor on a terminal, `NULL` to read the file descriptor directly
+  editor *editor;
+  char *buffer;
+  size_t buffer_start;
+  size_t buffer_end;
+  char *command;
+  size_t command_length;
+  size_t command_capacity;
+} input_reader;
+
+input_reader *input_new(int32_t file_descriptor, bool interactive);
+char *input_read_command(input_reader *reader);
+void input_free(input_reader *reader);
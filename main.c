@@ -6,19 +6,34 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <sys/wait.h>
 
 #include "logger.h"
 #include "arguments.h"
 #include "execution.h"
 #include "ast.h"
+#include "input.h"
+#include "server.h"
+#include "memory.h"
+#include "bulitins.h"
 #include "main.h"
 
 int32_t main(int32_t argc, char **argv, char **envp)
 {
-  FILE *input = stdin;
+  int32_t input = STDIN_FILENO;
+#ifdef MEMORY_DEBUG
+  memory_enable_leak_report();
+#endif
   int32_t opt;
-  while ((opt = getopt(argc, argv, "c:vh")) != -1)
+  char *server_path = NULL, *client_path = NULL;
+  size_t max_jobs = SERVER_MAX_JOBS;
+  struct option long_options[] = {{"server", required_argument, NULL, 's'},
+                                  {"client", required_argument, NULL, 'C'},
+                                  {"jobs", required_argument, NULL, 'j'},
+                                  {NULL, 0, NULL, 0}};
+  while ((opt = getopt_long(argc, argv, "+c:vh", long_options, NULL)) != -1)
   {
     switch (opt)
     {
@@ -34,6 +49,15 @@ int32_t main(int32_t argc, char **argv, char **envp)
     case 'h':
       print_help_and_exit();
       break;
+    case 's':
+      server_path = optarg;
+      break;
+    case 'C':
+      client_path = optarg;
+      break;
+    case 'j':
+      max_jobs = strtoul(optarg, NULL, 10);
+      break;
     case '?':
       logger(LOG_ERROR, "Unknown option\n");
       break;
@@ -41,42 +65,38 @@ int32_t main(int32_t argc, char **argv, char **envp)
       break;
     }
   }
+  if (server_path != NULL)
+    exit(server_run(server_path, max_jobs));
+  if (client_path != NULL)
+    exit(server_client(client_path, argc - optind, argv + optind));
   if (optind < argc)
   {
-    input = fopen(argv[optind], "r");
-    if (input == NULL)
+    input = open(argv[optind], O_RDONLY);
+    if (input == -1)
       logger(LOG_ERROR, "Failed to open file\n");
   }
 
+  input_reader *reader = input_new(input, input == STDIN_FILENO);
   char *line = NULL;
-  size_t length = 0;
-  ssize_t read = 0;
-  bool running = true;
-  while (running)
+  while ((line = input_read_command(reader)) != NULL)
   {
-    if (input == stdin)
-      printf(PROGRAM_NAME " $ ");
-    read = getline(&line, &length, input);
-    if (read == -1 && !feof(input))
-      logger(LOG_ERROR, "Failed to read line.\n");
     logger(LOG_DEBUG, "Parsing AST.\n");
-    fflush(stdout);
     AST *ast = ast_parse_command(ast_new(), line);
 #ifdef PRINT_AST
     logger(LOG_DEBUG, "Printing AST.\n");
     ast_print(ast);
 #endif
     logger(LOG_DEBUG, "Executing AST.\n");
-    execution(ast, 0, false);
+    if (ast != NULL)
+      execution(ast, 0, false);
     // Fallback :)
     waitpid(-1, NULL, WNOHANG);
     logger(LOG_DEBUG, "Freeing AST.\n");
     ast_free(ast);
-    free(line);
-    line = NULL;
     logger(LOG_DEBUG, "Line finished.\n");
-    if (feof(input))
-      running = false;
+    if (builtin_exit_requested)
+      break;
   }
+  input_free(reader);
   exit(EXIT_SUCCESS);
 }
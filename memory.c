@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "memory.h"
+#include "logger.h"
+
+typedef struct memory_header memory_header;
+
+/**
+ * @brief Bookkeeping stored right before every block handed out by this module.
+ * Aligned to `max_align_t` so the user pointer keeps the alignment `malloc()` guarantees.
+ */
+struct memory_header
+{
+  _Alignas(max_align_t) size_t size;
+  memory_subsystem subsystem;
+#ifdef MEMORY_DEBUG
+  memory_header *previous;
+  memory_header *next;
+#endif
+};
+
+static memory_allocator allocator = {malloc, realloc, free};
+static memory_statistics statistics[MEMORY_SUBSYSTEM_COUNT];
+static char *subsystem_names[MEMORY_SUBSYSTEM_COUNT] = {"parser",
+                                                        "executor",
+                                                        "builtins",
+                                                        "variables",
+                                                        "input",
+                                                        "server",
+                                                        "editor"};
+// Builtins in pipelines allocate from their own threads
+static pthread_mutex_t statistics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pid_t leak_report_owner = 0;
+#ifdef MEMORY_DEBUG
+static memory_header *live_blocks = NULL;
+#endif
+
+/**
+ * @brief Take the lock before `fork()`, a builtin thread may hold it and the child would never see it released.
+ */
+static void memory_fork_prepare()
+{
+  pthread_mutex_lock(&statistics_lock);
+}
+
+/**
+ * @brief Release the lock in the parent and the child after `fork()`.
+ */
+static void memory_fork_release()
+{
+  pthread_mutex_unlock(&statistics_lock);
+}
+
+/**
+ * @brief Register the `fork()` handlers before `main()`, before any process or thread is started.
+ */
+__attribute__((constructor)) static void memory_register_fork()
+{
+  pthread_atfork(memory_fork_prepare, memory_fork_release, memory_fork_release);
+}
+
+/**
+ * @brief Account a new block of `size` bytes to the subsystem.
+ */
+static void memory_track(memory_header *header, memory_subsystem subsystem, size_t size)
+{
+  header->size = size;
+  header->subsystem = subsystem;
+  pthread_mutex_lock(&statistics_lock);
+  memory_statistics *current = &statistics[subsystem];
+  current->live_bytes += size;
+  current->live_allocations++;
+  current->total_allocations++;
+  if (current->live_bytes > current->peak_bytes)
+    current->peak_bytes = current->live_bytes;
+#ifdef MEMORY_DEBUG
+  header->previous = NULL;
+  header->next = live_blocks;
+  if (live_blocks != NULL)
+    live_blocks->previous = header;
+  live_blocks = header;
+#endif
+  pthread_mutex_unlock(&statistics_lock);
+}
+
+/**
+ * @brief Remove the block from the accounting of its subsystem.
+ */
+static void memory_untrack(memory_header *header)
+{
+  pthread_mutex_lock(&statistics_lock);
+  memory_statistics *current = &statistics[header->subsystem];
+  current->live_bytes -= header->size;
+  current->live_allocations--;
+#ifdef MEMORY_DEBUG
+  if (header->previous != NULL)
+    header->previous->next = header->next;
+  else
+    live_blocks = header->next;
+  if (header->next != NULL)
+    header->next->previous = header->previous;
+#endif
+  pthread_mutex_unlock(&statistics_lock);
+}
+
+/**
+ * @brief Replace the underlying allocator.
+ * SHOULD only be called before anything is allocated, blocks are released with the allocator they came from.
+ */
+void memory_set_allocator(memory_allocator new_allocator)
+{
+  allocator = new_allocator;
+}
+
+/**
+ * @brief Allocate `size` bytes on behalf of the subsystem.
+ * @return The pointer to the memory, or `NULL` if the allocation failed.
+ */
+void *memory_malloc(memory_subsystem subsystem, size_t size)
+{
+  memory_header *header = allocator.malloc(sizeof(memory_header) + size);
+  if (header == NULL)
+  {
+    logger(LOG_WARNING, "Failed to allocate memory.\n");
+    return NULL;
+  }
+  memory_track(header, subsystem, size);
+  return header + 1;
+}
+
+/**
+ * @brief Allocate zeroed memory for an array of `count` elements on behalf of the subsystem.
+ */
+void *memory_calloc(memory_subsystem subsystem, size_t count, size_t size)
+{
+  if (size != 0 && count > SIZE_MAX / size)
+  {
+    logger(LOG_WARNING, "Allocation size overflow.\n");
+    return NULL;
+  }
+  void *pointer = memory_malloc(subsystem, count * size);
+  if (pointer != NULL)
+    memset(pointer, 0, count * size);
+  return pointer;
+}
+
+/**
+ * @brief Resize a block allocated by this module. A `NULL` pointer behaves like `memory_malloc()`.
+ * The block keeps the subsystem given here.
+ */
+void *memory_realloc(memory_subsystem subsystem, void *pointer, size_t size)
+{
+  if (pointer == NULL)
+    return memory_malloc(subsystem, size);
+  memory_header *header = (memory_header *)pointer - 1;
+  memory_untrack(header);
+  memory_header *new_header = allocator.realloc(header, sizeof(memory_header) + size);
+  if (new_header == NULL)
+  {
+    logger(LOG_WARNING, "Failed to reallocate memory.\n");
+    memory_track(header, header->subsystem, header->size);
+    return NULL;
+  }
+  memory_track(new_header, subsystem, size);
+  return new_header + 1;
+}
+
+/**
+ * @brief `strdup()` on behalf of the subsystem.
+ */
+char *memory_strdup(memory_subsystem subsystem, const char *string)
+{
+  return memory_strndup(subsystem, string, strlen(string));
+}
+
+/**
+ * @brief `strndup()` on behalf of the subsystem, the result is always null-terminated.
+ */
+char *memory_strndup(memory_subsystem subsystem, const char *string, size_t length)
+{
+  length = strnlen(string, length);
+  char *duplicated = memory_malloc(subsystem, length + 1);
+  if (duplicated == NULL)
+    return NULL;
+  memcpy(duplicated, string, length);
+  duplicated[length] = '\0';
+  return duplicated;
+}
+
+/**
+ * @brief Free a block allocated by this module. `NULL` is ignored.
+ */
+void memory_free(void *pointer)
+{
+  if (pointer == NULL)
+    return;
+  memory_header *header = (memory_header *)pointer - 1;
+  memory_untrack(header);
+  allocator.free(header);
+}
+
+/**
+ * @brief Get a snapshot of the statistics of the subsystem.
+ */
+memory_statistics memory_get_statistics(memory_subsystem subsystem)
+{
+  pthread_mutex_lock(&statistics_lock);
+  memory_statistics current = statistics[subsystem];
+  pthread_mutex_unlock(&statistics_lock);
+  return current;
+}
+
+/**
+ * @brief Print the statistics of every subsystem to the stream.
+ */
+void memory_print_statistics(FILE *stream)
+{
+  fprintf(stream, "%-10s %12s %12s %12s %12s\n", "subsystem", "live_bytes", "live_allocs", "total_allocs", "peak_bytes");
+  for (size_t i = 0; i <= MEMORY_SUBSYSTEM_COUNT - 1; i++)
+  {
+    memory_statistics current = memory_get_statistics(i);
+    fprintf(stream, "%-10s %12zu %12zu %12zu %12zu\n", subsystem_names[i], current.live_bytes,
+            current.live_allocations, current.total_allocations, current.peak_bytes);
+  }
+}
+
+/**
+ * @brief Report the blocks still alive to the standard error output.
+ * Forked children share the `atexit()` handler but stay silent.
+ */
+static void memory_report_leaks()
+{
+  if (leak_report_owner != getpid())
+    return;
+  for (size_t i = 0; i <= MEMORY_SUBSYSTEM_COUNT - 1; i++)
+  {
+    memory_statistics current = memory_get_statistics(i);
+    if (current.live_allocations != 0)
+      fprintf(stderr, "Leak: %s has %zu bytes in %zu allocations.\n", subsystem_names[i],
+              current.live_bytes, current.live_allocations);
+  }
+#ifdef MEMORY_DEBUG
+  for (memory_header *header = live_blocks; header != NULL; header = header->next)
+    fprintf(stderr, "Leak: %zu bytes at %p (%s).\n", header->size, (void *)(header + 1),
+            subsystem_names[header->subsystem]);
+#endif
+}
+
+/**
+ * @brief Report the leaked blocks when the current process exits.
+ */
+void memory_enable_leak_report()
+{
+  leak_report_owner = getpid();
+  atexit(memory_report_leaks);
+}
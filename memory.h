@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum
+{
+  MEMORY_PARSER,
+  MEMORY_EXECUTOR,
+  MEMORY_BUILTINS,
+  MEMORY_VARIABLES,
+  MEMORY_INPUT,
+  MEMORY_SERVER,
+  MEMORY_EDITOR,
+  MEMORY_SUBSYSTEM_COUNT
+} memory_subsystem;
+
+typedef struct
+{
+  void *(*malloc)(size_t size);
+  void *(*realloc)(void *pointer, size_t size);
+  void (*free)(void *pointer);
+} memory_allocator;
+
+typedef struct
+{
+  size_t live_bytes;
+  size_t live_allocations;
+  size_t total_allocations;
+  size_t peak_bytes;
+} memory_statistics;
+
+void memory_set_allocator(memory_allocator allocator);
+
+void *memory_malloc(memory_subsystem subsystem, size_t size);
+void *memory_calloc(memory_subsystem subsystem, size_t count, size_t size);
+void *memory_realloc(memory_subsystem subsystem, void *pointer, size_t size);
+char *memory_strdup(memory_subsystem subsystem, const char *string);
+char *memory_strndup(memory_subsystem subsystem, const char *string, size_t length);
+void memory_free(void *pointer);
+
+memory_statistics memory_get_statistics(memory_subsystem subsystem);
+void memory_print_statistics(FILE *stream);
+void memory_enable_leak_report();
@@ -0,0 +1,829 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#include "server.h"
+#include "ast.h"
+#include "execution.h"
+#include "input.h"
+#include "logger.h"
+#include "memory.h"
+#include "supervisor.h"
+
+typedef struct server_connection server_connection;
+
+typedef enum
+{
+  SERVER_LISTENER,
+  SERVER_CLIENT,
+  SERVER_JOB_EXIT,
+  SERVER_JOB_STDOUT,
+  SERVER_JOB_STDERR,
+} server_handle_kind;
+
+/**
+ * @brief What an epoll event refers to, stored in `epoll_event.data.ptr`.
+ */
+typedef struct
+{
+  server_handle_kind kind;
+  server_connection *connection;
+} server_handle;
+
+struct server_connection
+{
+  int32_t socket;
+  server_handle socket_handle;
+  server_handle stdout_handle;
+  server_handle stderr_handle;
+  server_handle exit_handle;
+  // Frames received from the client and not handled yet
+  char *input;
+  size_t input_length;
+  size_t input_capacity;
+  // Frames waiting for the client to accept them
+  char *output;
+  size_t output_length;
+  size_t output_capacity;
+  bool reading;
+  bool writing;
+  // The client sent its last command, its results are still delivered
+  bool input_closed;
+  bool hung_up;
+  // Released once the current batch of events is handled
+  bool closed;
+  // The running job, one at a time per connection
+  pid_t job;
+  int32_t job_pidfd;
+  int32_t job_stdout;
+  int32_t job_stderr;
+  bool job_exited;
+  int32_t job_status;
+  bool job_paused;
+  // When the job of a client which hung up is killed, `0` otherwise
+  int64_t job_kill_at;
+  server_connection *previous;
+  server_connection *next;
+};
+
+typedef struct
+{
+  int32_t listener;
+  int32_t epoll;
+  size_t jobs;
+  size_t max_jobs;
+  // Served in order, a connection moves to the end when its job finishes
+  server_connection *connections;
+  server_connection *last_connection;
+} server_state;
+
+static server_state server;
+static server_handle listener_handle = {SERVER_LISTENER, NULL};
+
+/**
+ * @brief Append the data to a growing buffer.
+ */
+static void server_append(char **buffer, size_t *length, size_t *capacity, void *data, size_t size)
+{
+  if (*length + size > *capacity)
+  {
+    while (*length + size > *capacity)
+      *capacity = *capacity == 0 ? SERVER_READ_SIZE : *capacity * 2;
+    *buffer = memory_realloc(MEMORY_SERVER, *buffer, *capacity);
+  }
+  memcpy(*buffer + *length, data, size);
+  *length += size;
+}
+
+/**
+ * @brief Encode the header of a frame.
+ */
+static void server_frame_header(char header[SERVER_FRAME_HEADER_SIZE], server_frame_type type, uint32_t length)
+{
+  header[0] = type;
+  memcpy(header + 1, &length, sizeof(uint32_t));
+}
+
+/**
+ * @brief (Un)register the file descriptor in the epoll instance.
+ */
+static void server_watch(int32_t operation, int32_t file_descriptor, uint32_t events, server_handle *handle)
+{
+  struct epoll_event event = {.events = events, .data.ptr = handle};
+  if (epoll_ctl(server.epoll, operation, file_descriptor, &event) == -1)
+    logger(LOG_WARNING, "Failed to update epoll.\n");
+}
+
+/**
+ * @brief Stop (or restart) reading the output of the job, the client is not keeping up.
+ */
+static void server_pause_job(server_connection *connection, bool pause)
+{
+  if (connection->job_paused == pause)
+    return;
+  connection->job_paused = pause;
+  int32_t operation = pause ? EPOLL_CTL_DEL : EPOLL_CTL_ADD;
+  if (connection->job_stdout != -1)
+    server_watch(operation, connection->job_stdout, EPOLLIN, &connection->stdout_handle);
+  if (connection->job_stderr != -1)
+    server_watch(operation, connection->job_stderr, EPOLLIN, &connection->stderr_handle);
+}
+
+/**
+ * @brief Update the events watched on the client socket.
+ * Its commands are read until it sends no more and while less than `SERVER_INPUT_LIMIT` bytes wait, its output is
+ * written while some is pending. A hang up is reported either way.
+ */
+static void server_watch_client(server_connection *connection)
+{
+  if (connection->hung_up)
+    return;
+  bool reading = !connection->input_closed && connection->input_length < SERVER_INPUT_LIMIT;
+  bool writing = connection->output_length > 0;
+  if (reading == connection->reading && writing == connection->writing)
+    return;
+  connection->reading = reading;
+  connection->writing = writing;
+  server_watch(EPOLL_CTL_MOD, connection->socket, (reading ? EPOLLIN : 0) | (writing ? EPOLLOUT : 0),
+               &connection->socket_handle);
+}
+
+static void server_hang_up(server_connection *connection);
+
+/**
+ * @brief Send as much of the pending output as the client accepts without blocking.
+ */
+static void server_flush(server_connection *connection)
+{
+  if (connection->hung_up)
+    return;
+  size_t sent = 0;
+  while (sent < connection->output_length)
+  {
+    ssize_t result = send(connection->socket, connection->output + sent, connection->output_length - sent,
+                          MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (result == -1)
+    {
+      server_hang_up(connection);
+      return;
+    }
+    sent += result;
+  }
+  memmove(connection->output, connection->output + sent, connection->output_length - sent);
+  connection->output_length -= sent;
+  server_watch_client(connection);
+  if (connection->job != 0)
+    server_pause_job(connection, connection->output_length > SERVER_OUTPUT_LIMIT);
+}
+
+/**
+ * @brief Queue a frame for the client.
+ */
+static void server_send(server_connection *connection, server_frame_type type, void *payload, uint32_t length)
+{
+  if (connection->hung_up)
+    return;
+  char header[SERVER_FRAME_HEADER_SIZE];
+  server_frame_header(header, type, length);
+  server_append(&connection->output, &connection->output_length, &connection->output_capacity, header,
+                SERVER_FRAME_HEADER_SIZE);
+  server_append(&connection->output, &connection->output_length, &connection->output_capacity, payload, length);
+  server_flush(connection);
+}
+
+/**
+ * @brief Close the connection. SHOULD only be called once its job finished.
+ * The memory is released by `server_release()`, events of this batch may still refer to it.
+ */
+static void server_close(server_connection *connection)
+{
+  if (connection->closed)
+    return;
+  if (!connection->hung_up)
+    server_watch(EPOLL_CTL_DEL, connection->socket, 0, NULL);
+  close(connection->socket);
+  connection->closed = true;
+}
+
+/**
+ * @brief Remove the connection from the list.
+ */
+static void server_unlink(server_connection *connection)
+{
+  if (connection->previous != NULL)
+    connection->previous->next = connection->next;
+  else
+    server.connections = connection->next;
+  if (connection->next != NULL)
+    connection->next->previous = connection->previous;
+  else
+    server.last_connection = connection->previous;
+  connection->previous = connection->next = NULL;
+}
+
+/**
+ * @brief Add the connection at the end of the list, it is served after the others.
+ */
+static void server_link_last(server_connection *connection)
+{
+  connection->previous = server.last_connection;
+  if (server.last_connection != NULL)
+    server.last_connection->next = connection;
+  else
+    server.connections = connection;
+  server.last_connection = connection;
+}
+
+/**
+ * @brief Free the closed connections.
+ */
+static void server_release()
+{
+  server_connection *connection = server.connections;
+  while (connection != NULL)
+  {
+    server_connection *next = connection->next;
+    if (connection->closed)
+    {
+      server_unlink(connection);
+      memory_free(connection->input);
+      memory_free(connection->output);
+      memory_free(connection);
+    }
+    connection = next;
+  }
+}
+
+/**
+ * @brief Run the command in a forked job, its standard output and error are pipes read by the event loop.
+ */
+static void server_start_job(server_connection *connection, char *command)
+{
+  int32_t stdout_pipe[2], stderr_pipe[2];
+  if (pipe2(stdout_pipe, O_CLOEXEC) == -1)
+  {
+    logger(LOG_WARNING, "Failed to create pipe.\n");
+    return;
+  }
+  if (pipe2(stderr_pipe, O_CLOEXEC) == -1)
+  {
+    logger(LOG_WARNING, "Failed to create pipe.\n");
+    close(stdout_pipe[0]);
+    close(stdout_pipe[1]);
+    return;
+  }
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = execution_fork();
+  if (pid == 0)
+  {
+    dup2(stdout_pipe[1], STDOUT_FILENO);
+    dup2(stderr_pipe[1], STDERR_FILENO);
+    int32_t null = open("/dev/null", O_RDONLY);
+    if (null != -1)
+      dup2(null, STDIN_FILENO);
+    // The descriptors of the server are close-on-exec, but `execution()` does not always exec
+    close(server.listener);
+    close(server.epoll);
+    for (server_connection *other = server.connections; other != NULL; other = other->next)
+    {
+      if (!other->closed)
+        close(other->socket);
+      if (other->job_pidfd != -1)
+        close(other->job_pidfd);
+      if (other->job_stdout != -1)
+        close(other->job_stdout);
+      if (other->job_stderr != -1)
+        close(other->job_stderr);
+    }
+    AST *ast = ast_parse_command(ast_new(), command);
+    exit(execution(ast, true, false));
+  }
+  close(stdout_pipe[1]);
+  close(stderr_pipe[1]);
+  if (pid == -1)
+  {
+    logger(LOG_WARNING, "Failed to fork job.\n");
+    close(stdout_pipe[0]);
+    close(stderr_pipe[0]);
+    int32_t status = EXIT_FAILURE;
+    server_send(connection, SERVER_FRAME_STATUS, &status, sizeof(status));
+    return;
+  }
+  fcntl(stdout_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(stderr_pipe[0], F_SETFL, O_NONBLOCK);
+  connection->job = pid;
+  connection->job_stdout = stdout_pipe[0];
+  connection->job_stderr = stderr_pipe[0];
+  connection->job_exited = false;
+  connection->job_paused = false;
+  // The pidfd becomes readable once the job exits, without it the job is reaped when its pipes close
+  connection->job_pidfd = supervisor_pidfd(pid);
+  if (connection->job_pidfd != -1)
+    server_watch(EPOLL_CTL_ADD, connection->job_pidfd, EPOLLIN, &connection->exit_handle);
+  server_watch(EPOLL_CTL_ADD, connection->job_stdout, EPOLLIN, &connection->stdout_handle);
+  server_watch(EPOLL_CTL_ADD, connection->job_stderr, EPOLLIN, &connection->stderr_handle);
+  server.jobs++;
+}
+
+/**
+ * @brief Check if a whole command frame of the client waits.
+ */
+static bool server_has_command(server_connection *connection)
+{
+  if (connection->input_length < SERVER_FRAME_HEADER_SIZE)
+    return false;
+  uint32_t length;
+  memcpy(&length, connection->input + 1, sizeof(uint32_t));
+  return connection->input_length >= SERVER_FRAME_HEADER_SIZE + length;
+}
+
+/**
+ * @brief Start the next command of every idle connection, as long as jobs are available.
+ * The connections are visited in the order their last job finished, the waiting clients take turns.
+ */
+static void server_schedule()
+{
+  for (server_connection *connection = server.connections; connection != NULL; connection = connection->next)
+  {
+    if (connection->closed)
+      continue;
+    // The commands of a client which hung up are not run
+    if (connection->hung_up)
+    {
+      if (connection->job == 0)
+        server_close(connection);
+      continue;
+    }
+    if (connection->job == 0 && server.jobs < server.max_jobs && connection->input_length >= SERVER_FRAME_HEADER_SIZE)
+    {
+      uint32_t length;
+      memcpy(&length, connection->input + 1, sizeof(uint32_t));
+      size_t frame_length = SERVER_FRAME_HEADER_SIZE + length;
+      if (connection->input[0] != SERVER_FRAME_COMMAND || length > SERVER_COMMAND_LIMIT)
+      {
+        logger(LOG_WARNING, "Invalid frame from client.\n");
+        server_close(connection);
+      }
+      else if (connection->input_length >= frame_length)
+      {
+        char *command = memory_strndup(MEMORY_SERVER, connection->input + SERVER_FRAME_HEADER_SIZE, length);
+        memmove(connection->input, connection->input + frame_length, connection->input_length - frame_length);
+        connection->input_length -= frame_length;
+        server_watch_client(connection);
+        server_start_job(connection, command);
+        memory_free(command);
+        continue;
+      }
+    }
+    // A client done sending is closed once its commands ran and their results were sent
+    if (connection->input_closed && connection->job == 0 && connection->output_length == 0 &&
+        !server_has_command(connection))
+      server_close(connection);
+  }
+}
+
+/**
+ * @brief Send the status once the job exited and both of its pipes are drained.
+ */
+static void server_finish_job(server_connection *connection)
+{
+  if (connection->job == 0 || connection->job_stdout != -1 || connection->job_stderr != -1)
+    return;
+  // Without a pidfd the job of a client which hung up is waited for once killed
+  if (!connection->job_exited && connection->job_pidfd == -1 && !connection->hung_up)
+  {
+    int32_t status = 0;
+    waitpid(connection->job, &status, 0);
+    connection->job_exited = true;
+    connection->job_status = supervisor_exit_status(status);
+  }
+  if (!connection->job_exited)
+    return;
+  server_send(connection, SERVER_FRAME_STATUS, &connection->job_status, sizeof(int32_t));
+  connection->job = 0;
+  connection->job_kill_at = 0;
+  // The job of a client which hung up gave its slot back already
+  if (connection->hung_up)
+  {
+    server_close(connection);
+    return;
+  }
+  server.jobs--;
+  // Behind the clients already waiting for a job
+  server_unlink(connection);
+  server_link_last(connection);
+}
+
+/**
+ * @brief Send the signal to the job through its pidfd.
+ */
+static void server_signal_job(server_connection *connection, int32_t signal)
+{
+  if (connection->job_pidfd != -1)
+    syscall(SYS_pidfd_send_signal, connection->job_pidfd, signal, NULL, 0);
+  else
+    kill(connection->job, signal);
+}
+
+/**
+ * @brief The client is gone: drop its output and its waiting commands, and stop its job.
+ * The job gives its slot back at once, it gets `SIGTERM` now and `SIGKILL` after `SERVER_KILL_AFTER`.
+ */
+static void server_hang_up(server_connection *connection)
+{
+  if (connection->hung_up)
+    return;
+  server_watch(EPOLL_CTL_DEL, connection->socket, 0, NULL);
+  connection->hung_up = true;
+  connection->input_length = 0;
+  connection->output_length = 0;
+  if (connection->job == 0)
+    return;
+  server.jobs--;
+  if (!connection->job_exited)
+  {
+    server_signal_job(connection, SIGTERM);
+    connection->job_kill_at = supervisor_now() + SERVER_KILL_AFTER;
+  }
+  // Its output is not read anymore, a job writing more gets `SIGPIPE`
+  int32_t *outputs[] = {&connection->job_stdout, &connection->job_stderr};
+  server_handle *handles[] = {&connection->stdout_handle, &connection->stderr_handle};
+  for (size_t i = 0; i <= 1; i++)
+  {
+    if (*outputs[i] == -1)
+      continue;
+    if (!connection->job_paused)
+      server_watch(EPOLL_CTL_DEL, *outputs[i], 0, handles[i]);
+    close(*outputs[i]);
+    *outputs[i] = -1;
+  }
+  server_finish_job(connection);
+}
+
+/**
+ * @brief Send `SIGKILL` to the jobs of clients which hung up still running after `SERVER_KILL_AFTER`.
+ */
+static void server_kill_jobs()
+{
+  int64_t now = supervisor_now();
+  for (server_connection *connection = server.connections; connection != NULL; connection = connection->next)
+  {
+    if (connection->closed || connection->job == 0 || connection->job_kill_at == 0 || now < connection->job_kill_at)
+      continue;
+    connection->job_kill_at = 0;
+    server_signal_job(connection, SIGKILL);
+    // Without a pidfd, nothing else reports the exit of the job
+    if (connection->job_pidfd == -1)
+    {
+      int32_t status = 0;
+      waitpid(connection->job, &status, 0);
+      connection->job_exited = true;
+      connection->job_status = supervisor_exit_status(status);
+      server_finish_job(connection);
+    }
+  }
+}
+
+/**
+ * @brief Milliseconds until the next job has to be killed, `-1` if none has to.
+ */
+static int32_t server_next_timeout()
+{
+  int64_t next = -1;
+  for (server_connection *connection = server.connections; connection != NULL; connection = connection->next)
+    if (!connection->closed && connection->job != 0 && connection->job_kill_at != 0 &&
+        (next == -1 || connection->job_kill_at < next))
+      next = connection->job_kill_at;
+  if (next == -1)
+    return -1;
+  int64_t remaining = next - supervisor_now();
+  return remaining > 0 ? remaining : 0;
+}
+
+/**
+ * @brief Forward a chunk of the output of the job to the client.
+ */
+static void server_read_job(server_connection *connection, server_handle_kind kind)
+{
+  int32_t *file_descriptor = kind == SERVER_JOB_STDOUT ? &connection->job_stdout : &connection->job_stderr;
+  // Closed by a hang up handled in this batch of events
+  if (*file_descriptor == -1)
+    return;
+  static char buffer[SERVER_READ_SIZE];
+  ssize_t result = read(*file_descriptor, buffer, SERVER_READ_SIZE);
+  if (result == -1 && (errno == EINTR || errno == EAGAIN))
+    return;
+  if (result > 0)
+  {
+    server_send(connection, kind == SERVER_JOB_STDOUT ? SERVER_FRAME_STDOUT : SERVER_FRAME_STDERR, buffer, result);
+    return;
+  }
+  if (!connection->job_paused)
+    server_watch(EPOLL_CTL_DEL, *file_descriptor, 0, NULL);
+  close(*file_descriptor);
+  *file_descriptor = -1;
+  server_finish_job(connection);
+}
+
+/**
+ * @brief Collect the exit status of the job, its pidfd reported that it exited.
+ */
+static void server_reap(server_connection *connection)
+{
+  int32_t status = 0;
+  waitpid(connection->job, &status, WNOHANG);
+  server_watch(EPOLL_CTL_DEL, connection->job_pidfd, 0, NULL);
+  close(connection->job_pidfd);
+  connection->job_pidfd = -1;
+  connection->job_exited = true;
+  connection->job_status = supervisor_exit_status(status);
+  server_finish_job(connection);
+}
+
+/**
+ * @brief Receive the frames sent by the client.
+ * The end of file only means the client sends no more commands, it still receives the results of the others.
+ */
+static void server_read_client(server_connection *connection)
+{
+  if (connection->hung_up || !connection->reading)
+    return;
+  char buffer[SERVER_READ_SIZE];
+  ssize_t result = recv(connection->socket, buffer, SERVER_READ_SIZE, MSG_DONTWAIT);
+  if (result == -1 && (errno == EINTR || errno == EAGAIN))
+    return;
+  if (result == -1)
+  {
+    server_hang_up(connection);
+    return;
+  }
+  if (result == 0)
+  {
+    connection->input_closed = true;
+    server_watch_client(connection);
+    return;
+  }
+  server_append(&connection->input, &connection->input_length, &connection->input_capacity, buffer, result);
+  server_watch_client(connection);
+}
+
+/**
+ * @brief Accept every pending client.
+ */
+static void server_accept()
+{
+  int32_t client;
+  while ((client = accept4(server.listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+  {
+    server_connection *connection = memory_calloc(MEMORY_SERVER, 1, sizeof(server_connection));
+    connection->socket = client;
+    connection->socket_handle = (server_handle){SERVER_CLIENT, connection};
+    connection->stdout_handle = (server_handle){SERVER_JOB_STDOUT, connection};
+    connection->stderr_handle = (server_handle){SERVER_JOB_STDERR, connection};
+    connection->exit_handle = (server_handle){SERVER_JOB_EXIT, connection};
+    connection->job_pidfd = -1;
+    connection->job_stdout = -1;
+    connection->job_stderr = -1;
+    connection->reading = true;
+    // After the clients already waiting
+    server_link_last(connection);
+    server_watch(EPOLL_CTL_ADD, client, EPOLLIN, &connection->socket_handle);
+  }
+}
+
+/**
+ * @brief Serve the commands of the clients connecting to the UNIX socket, until a fatal error occurs.
+ * @param max_jobs The number of commands executed at the same time, the others wait for a free job.
+ * @return `EXIT_FAILURE` if the server could not be set up.
+ */
+int32_t server_run(char *path, size_t max_jobs)
+{
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path))
+  {
+    logger(LOG_WARNING, "Socket path too long.\n");
+    return EXIT_FAILURE;
+  }
+  strcpy(address.sun_path, path);
+  server.max_jobs = max_jobs == 0 ? SERVER_MAX_JOBS : max_jobs;
+  server.listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  unlink(path);
+  if (server.listener == -1 || bind(server.listener, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+      listen(server.listener, SOMAXCONN) == -1)
+  {
+    logger(LOG_WARNING, "Failed to listen on the socket.\n");
+    return EXIT_FAILURE;
+  }
+  server.epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (server.epoll == -1)
+  {
+    logger(LOG_WARNING, "Failed to set up the event loop.\n");
+    return EXIT_FAILURE;
+  }
+  server_watch(EPOLL_CTL_ADD, server.listener, EPOLLIN, &listener_handle);
+
+  struct epoll_event events[SERVER_EVENTS];
+  while (true)
+  {
+    int32_t count = epoll_wait(server.epoll, events, SERVER_EVENTS, server_next_timeout());
+    if (count == -1 && errno == EINTR)
+      continue;
+    if (count == -1)
+    {
+      logger(LOG_WARNING, "Failed to wait for events.\n");
+      return EXIT_FAILURE;
+    }
+    for (int32_t i = 0; i <= count - 1; i++)
+    {
+      server_handle *handle = events[i].data.ptr;
+      if (handle->connection != NULL && handle->connection->closed)
+        continue;
+      switch (handle->kind)
+      {
+      case SERVER_LISTENER:
+        server_accept();
+        break;
+      case SERVER_JOB_EXIT:
+        server_reap(handle->connection);
+        break;
+      case SERVER_CLIENT:
+        // Reported whatever is watched, once the client closed both directions or failed
+        if (events[i].events & (EPOLLHUP | EPOLLERR))
+          server_hang_up(handle->connection);
+        else if (events[i].events & EPOLLOUT)
+          server_flush(handle->connection);
+        else
+          server_read_client(handle->connection);
+        break;
+      case SERVER_JOB_STDOUT:
+      case SERVER_JOB_STDERR:
+        server_read_job(handle->connection, handle->kind);
+        break;
+      }
+    }
+    server_kill_jobs();
+    server_schedule();
+    server_release();
+  }
+}
+
+/**
+ * @brief Read exactly `length` bytes.
+ * @return `false` on error or end of file.
+ */
+static bool server_read_all(int32_t file_descriptor, void *buffer, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t result = read(file_descriptor, buffer, length);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result <= 0)
+      return false;
+    buffer = (char *)buffer + result;
+    length -= result;
+  }
+  return true;
+}
+
+/**
+ * @brief Write exactly `length` bytes.
+ * @return `false` on error.
+ */
+static bool server_write_all(int32_t file_descriptor, void *buffer, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t result = write(file_descriptor, buffer, length);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1)
+      return false;
+    buffer = (char *)buffer + result;
+    length -= result;
+  }
+  return true;
+}
+
+/**
+ * @brief Submit the command and relay its output until the server reports its status.
+ * If the output can not be written anymore, the connection is shut down and the server stops the command.
+ * @param output_lost Set to `true` if the output can not be written anymore.
+ * @return The exit status of the command, `128 + SIGPIPE` if the output was lost.
+ */
+static int32_t server_submit(int32_t server_socket, char *command, bool *output_lost)
+{
+  char header[SERVER_FRAME_HEADER_SIZE];
+  server_frame_header(header, SERVER_FRAME_COMMAND, strlen(command));
+  if (!server_write_all(server_socket, header, SERVER_FRAME_HEADER_SIZE) ||
+      !server_write_all(server_socket, command, strlen(command)))
+  {
+    logger(LOG_WARNING, "Failed to submit the command.\n");
+    return EXIT_FAILURE;
+  }
+  char *payload = NULL;
+  size_t capacity = 0;
+  int32_t status = EXIT_FAILURE;
+  while (server_read_all(server_socket, header, SERVER_FRAME_HEADER_SIZE))
+  {
+    uint32_t length;
+    memcpy(&length, header + 1, sizeof(uint32_t));
+    if (length > capacity)
+    {
+      capacity = length;
+      payload = memory_realloc(MEMORY_SERVER, payload, capacity);
+    }
+    if (!server_read_all(server_socket, payload, length))
+      break;
+    bool written = true;
+    if (header[0] == SERVER_FRAME_STDOUT)
+      written = server_write_all(STDOUT_FILENO, payload, length);
+    else if (header[0] == SERVER_FRAME_STDERR)
+      written = server_write_all(STDERR_FILENO, payload, length);
+    // Like `SIGPIPE` would, the reader of the output is gone
+    if (!written)
+    {
+      shutdown(server_socket, SHUT_RDWR);
+      *output_lost = true;
+      memory_free(payload);
+      return 128 + SIGPIPE;
+    }
+    if (header[0] == SERVER_FRAME_STATUS && length == sizeof(int32_t))
+    {
+      memcpy(&status, payload, sizeof(int32_t));
+      memory_free(payload);
+      return status;
+    }
+  }
+  logger(LOG_WARNING, "Connection to the server lost.\n");
+  memory_free(payload);
+  return EXIT_FAILURE;
+}
+
+/**
+ * @brief Submit commands to a shell running in server mode.
+ * The command is made of the arguments, or every command of the standard input is submitted if none are given.
+ * @return The exit status of the last command.
+ */
+int32_t server_client(char *path, int32_t argc, char **argv)
+{
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path))
+  {
+    logger(LOG_WARNING, "Socket path too long.\n");
+    return EXIT_FAILURE;
+  }
+  strcpy(address.sun_path, path);
+  int32_t server_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (server_socket == -1 || connect(server_socket, (struct sockaddr *)&address, sizeof(address)) == -1)
+  {
+    logger(LOG_WARNING, "Failed to connect to the server.\n");
+    return EXIT_FAILURE;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  int32_t status = EXIT_SUCCESS;
+  bool output_lost = false;
+  if (argc > 0)
+  {
+    size_t length = 0;
+    for (int32_t i = 0; i <= argc - 1; i++)
+      length += strlen(argv[i]) + 1;
+    char *command = memory_calloc(MEMORY_SERVER, length, sizeof(char));
+    for (int32_t i = 0; i <= argc - 1; i++)
+    {
+      if (i != 0)
+        strcat(command, " ");
+      strcat(command, argv[i]);
+    }
+    status = server_submit(server_socket, command, &output_lost);
+    memory_free(command);
+  }
+  else
+  {
+    input_reader *reader = input_new(STDIN_FILENO, false);
+    char *command;
+    while (!output_lost && (command = input_read_command(reader)) != NULL)
+      if (*command != '\0')
+        status = server_submit(server_socket, command, &output_lost);
+    input_free(reader);
+  }
+  close(server_socket);
+  return status;
+}
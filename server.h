@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SERVER_MAX_JOBS 16
+#define SERVER_READ_SIZE (64 * 1024)
+// Stop reading the output of a job while this many bytes wait for a slow client
+#define SERVER_OUTPUT_LIMIT (1024 * 1024)
+#define SERVER_COMMAND_LIMIT (1024 * 1024)
+// Stop reading the commands of a client while this many bytes wait, more than a whole command frame
+#define SERVER_INPUT_LIMIT (2 * SERVER_COMMAND_LIMIT)
+#define SERVER_EVENTS 64
+// Milliseconds between `SIGTERM` and `SIGKILL` for the job of a client which hung up
+#define SERVER_KILL_AFTER 5000
+
+/**
+ * Both directions exchange frames: a one byte `server_frame_type`, a `uint32_t` payload length in host byte order
+ * and the payload. The client sends `SERVER_FRAME_COMMAND` frames one after the other, the server answers every
+ * command with its `SERVER_FRAME_STDOUT` and `SERVER_FRAME_STDERR` frames followed by a `SERVER_FRAME_STATUS`
+ * frame holding the `int32_t` exit status.
+ */
+typedef enum
+{
+  SERVER_FRAME_COMMAND = 'c',
+  SERVER_FRAME_STDOUT = 'o',
+  SERVER_FRAME_STDERR = 'e',
+  SERVER_FRAME_STATUS = 's',
+} server_frame_type;
+
+#define SERVER_FRAME_HEADER_SIZE (sizeof(char) + sizeof(uint32_t))
+
+int32_t server_run(char *path, size_t max_jobs);
+int32_t server_client(char *path, int32_t argc, char **argv);
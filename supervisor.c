@@ -0,0 +1,280 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#include "supervisor.h"
+#include "logger.h"
+#include "memory.h"
+
+#define SUPERVISOR_CHILDREN_SIZE 4
+
+// An epoll instance kept per thread between supervisors, supervising a command does not create one every time.
+// The value is the file descriptor plus one, `NULL` if the thread has none.
+static pthread_key_t idle_epoll;
+static pthread_once_t idle_epoll_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Open a file descriptor referring to the process, readable once it exits.
+ * @return The pidfd, or `-1` if the kernel does not support them.
+ */
+int32_t supervisor_pidfd(pid_t pid)
+{
+  return syscall(SYS_pidfd_open, pid, 0);
+}
+
+/**
+ * @brief Convert a `waitpid()` status to a shell exit status, `128 + signal` for killed processes.
+ */
+int32_t supervisor_exit_status(int32_t status)
+{
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  return WEXITSTATUS(status);
+}
+
+/**
+ * @brief The monotonic clock in milliseconds, the reference of the deadlines.
+ */
+int64_t supervisor_now()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Take the idle epoll instance of the thread.
+ * @return The epoll instance, `-1` if the thread has none.
+ */
+static int32_t supervisor_take_idle()
+{
+  int32_t epoll = (intptr_t)pthread_getspecific(idle_epoll) - 1;
+  pthread_setspecific(idle_epoll, NULL);
+  return epoll;
+}
+
+/**
+ * @brief Close the idle epoll instance of a thread exiting, the stages of pipelines run on short-lived threads.
+ */
+static void supervisor_close_idle(void *value)
+{
+  close((intptr_t)value - 1);
+}
+
+/**
+ * @brief Drop the idle epoll instance in a forked child, it is shared with the parent.
+ */
+static void supervisor_fork_child()
+{
+  int32_t epoll = supervisor_take_idle();
+  if (epoll != -1)
+    close(epoll);
+}
+
+/**
+ * @brief Create the key of the idle epoll instances and register `supervisor_fork_child()`, once per process.
+ */
+static void supervisor_register_idle()
+{
+  pthread_key_create(&idle_epoll, supervisor_close_idle);
+  pthread_atfork(NULL, NULL, supervisor_fork_child);
+}
+
+/**
+ * @brief Create a supervisor, an epoll instance watching the pidfds of its children.
+ * The epoll instance of the last supervisor freed on this thread is reused.
+ */
+supervisor *supervisor_new()
+{
+  pthread_once(&idle_epoll_once, supervisor_register_idle);
+  supervisor *new_supervisor = memory_calloc(MEMORY_EXECUTOR, 1, sizeof(supervisor));
+  new_supervisor->epoll = supervisor_take_idle();
+  if (new_supervisor->epoll == -1)
+    new_supervisor->epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (new_supervisor->epoll == -1)
+    logger(LOG_WARNING, "Failed to create epoll instance.\n");
+  new_supervisor->capacity = SUPERVISOR_CHILDREN_SIZE;
+  new_supervisor->children = memory_calloc(MEMORY_EXECUTOR, new_supervisor->capacity, sizeof(supervisor_child));
+  return new_supervisor;
+}
+
+/**
+ * @brief Supervise a child of the current process.
+ * @return The index of the child in the supervisor.
+ */
+size_t supervisor_add(supervisor *supervisor, pid_t pid)
+{
+  if (supervisor->count == supervisor->capacity)
+  {
+    supervisor->capacity *= 2;
+    supervisor->children = memory_realloc(MEMORY_EXECUTOR, supervisor->children,
+                                          supervisor->capacity * sizeof(supervisor_child));
+  }
+  size_t index = supervisor->count++;
+  supervisor_child *child = &supervisor->children[index];
+  child->pid = pid;
+  child->status = 0;
+  child->exited = false;
+  child->pidfd = supervisor->epoll == -1 ? -1 : supervisor_pidfd(pid);
+  if (child->pidfd != -1)
+  {
+    struct epoll_event event = {.events = EPOLLIN, .data.u64 = index};
+    if (epoll_ctl(supervisor->epoll, EPOLL_CTL_ADD, child->pidfd, &event) == -1)
+    {
+      close(child->pidfd);
+      child->pidfd = -1;
+    }
+  }
+  supervisor->running++;
+  return index;
+}
+
+/**
+ * @brief Reap the child, it has exited or is about to.
+ */
+static void supervisor_reap(supervisor *supervisor, size_t index)
+{
+  supervisor_child *child = &supervisor->children[index];
+  int32_t status = 0;
+  while (waitpid(child->pid, &status, 0) == -1 && errno == EINTR)
+    ;
+  child->status = supervisor_exit_status(status);
+  child->exited = true;
+  supervisor->running--;
+  if (child->pidfd != -1)
+  {
+    epoll_ctl(supervisor->epoll, EPOLL_CTL_DEL, child->pidfd, NULL);
+    close(child->pidfd);
+    child->pidfd = -1;
+  }
+}
+
+/**
+ * @brief Wait until any of the children exits.
+ * Children without a pidfd (old kernels) are waited for with a blocking `waitpid()` ignoring the deadline.
+ * @param deadline The `supervisor_now()` time to give up at, `-1` to wait forever.
+ * @return The index of the child which exited, `SUPERVISOR_TIMEOUT` if the deadline passed
+ * or `SUPERVISOR_NONE` if no child is running.
+ */
+ssize_t supervisor_wait_any(supervisor *supervisor, int64_t deadline)
+{
+  if (supervisor->running == 0)
+    return SUPERVISOR_NONE;
+  for (size_t i = 0; i <= supervisor->count - 1; i++)
+    if (!supervisor->children[i].exited && supervisor->children[i].pidfd == -1)
+    {
+      supervisor_reap(supervisor, i);
+      return i;
+    }
+  while (true)
+  {
+    int32_t timeout = -1;
+    if (deadline >= 0)
+    {
+      int64_t remaining = deadline - supervisor_now();
+      // A longer wait is resumed below
+      timeout = remaining > INT32_MAX ? INT32_MAX : remaining > 0 ? remaining : 0;
+    }
+    struct epoll_event event;
+    int32_t result = epoll_wait(supervisor->epoll, &event, 1, timeout);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1)
+    {
+      logger(LOG_WARNING, "Failed to wait for children.\n");
+      return SUPERVISOR_NONE;
+    }
+    if (result == 0 && supervisor_now() < deadline)
+      continue;
+    if (result == 0)
+      return SUPERVISOR_TIMEOUT;
+    supervisor_reap(supervisor, event.data.u64);
+    return event.data.u64;
+  }
+}
+
+/**
+ * @brief Wait until every child exited, in whichever order they finish.
+ */
+void supervisor_wait_all(supervisor *supervisor)
+{
+  while (supervisor_wait_any(supervisor, -1) >= 0)
+    ;
+}
+
+/**
+ * @brief Send the signal to the child. The pidfd makes sure a recycled pid is never signaled.
+ * @return `0` on success, `-1` otherwise.
+ */
+int32_t supervisor_signal(supervisor *supervisor, size_t index, int32_t signal)
+{
+  supervisor_child *child = &supervisor->children[index];
+  if (child->exited)
+    return -1;
+  if (child->pidfd != -1)
+    return syscall(SYS_pidfd_send_signal, child->pidfd, signal, NULL, 0);
+  return kill(child->pid, signal);
+}
+
+/**
+ * @brief Send the signal to the process group led by the child, reaching the processes it started.
+ * The child is not reaped yet, so its pid still names its group.
+ * @return `0` on success, `-1` otherwise.
+ */
+int32_t supervisor_signal_group(supervisor *supervisor, size_t index, int32_t signal)
+{
+  supervisor_child *child = &supervisor->children[index];
+  if (child->exited)
+    return -1;
+  return kill(-child->pid, signal);
+}
+
+/**
+ * @brief The exit status of the child, only meaningful once it exited.
+ */
+int32_t supervisor_status(supervisor *supervisor, size_t index)
+{
+  return supervisor->children[index].status;
+}
+
+/**
+ * @brief Supervise a single child until it exits.
+ * @return The exit status of the child.
+ */
+int32_t supervisor_wait_one(pid_t pid)
+{
+  supervisor *children = supervisor_new();
+  size_t child = supervisor_add(children, pid);
+  supervisor_wait_all(children);
+  int32_t status = supervisor_status(children, child);
+  supervisor_free(children);
+  return status;
+}
+
+/**
+ * @brief Free the supervisor. Children still running are left alone.
+ * The epoll instance is kept for the next supervisor of this thread, closing the pidfds emptied it.
+ */
+void supervisor_free(supervisor *supervisor)
+{
+  if (supervisor == NULL)
+    return;
+  for (size_t i = 0; i < supervisor->count; i++)
+    if (supervisor->children[i].pidfd != -1)
+      close(supervisor->children[i].pidfd);
+  if (supervisor->epoll != -1 && pthread_getspecific(idle_epoll) == NULL)
+    pthread_setspecific(idle_epoll, (void *)(intptr_t)(supervisor->epoll + 1));
+  else if (supervisor->epoll != -1)
+    close(supervisor->epoll);
+  memory_free(supervisor->children);
+  memory_free(supervisor);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define SUPERVISOR_TIMEOUT -1
+#define SUPERVISOR_NONE -2
+
+typedef struct
+{
+  pid_t pid;
+  int32_t pidfd;
+  int32_t status;
+  bool exited;
+} supervisor_child;
+
+typedef struct
+{
+  int32_t epoll;
+  supervisor_child *children;
+  size_t count;
+  size_t capacity;
+  size_t running;
+} supervisor;
+
+int32_t supervisor_pidfd(pid_t pid);
+int32_t supervisor_exit_status(int32_t status);
+int64_t supervisor_now();
+
+supervisor *supervisor_new();
+size_t supervisor_add(supervisor *supervisor, pid_t pid);
+ssize_t supervisor_wait_any(supervisor *supervisor, int64_t deadline);
+void supervisor_wait_all(supervisor *supervisor);
+int32_t supervisor_signal(supervisor *supervisor, size_t index, int32_t signal);
+int32_t supervisor_signal_group(supervisor *supervisor, size_t index, int32_t signal);
+int32_t supervisor_status(supervisor *supervisor, size_t index);
+int32_t supervisor_wait_one(pid_t pid);
+void supervisor_free(supervisor *supervisor);
@@ -0,0 +1,244 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "transfer.h"
+#include "logger.h"
+#include "memory.h"
+
+typedef enum
+{
+  TRANSFER_OTHER,
+  TRANSFER_PIPE,
+  TRANSFER_FILE,
+} transfer_kind;
+
+/**
+ * @brief Tell which system calls are usable on the file descriptor.
+ */
+static transfer_kind transfer_get_kind(int32_t file_descriptor)
+{
+  struct stat status;
+  if (fstat(file_descriptor, &status) == -1)
+    return TRANSFER_OTHER;
+  if (S_ISFIFO(status.st_mode))
+    return TRANSFER_PIPE;
+  if (S_ISREG(status.st_mode))
+    return TRANSFER_FILE;
+  return TRANSFER_OTHER;
+}
+
+/**
+ * @brief The kernel can not do this transfer, but a plain `read()`/`write()` may.
+ */
+static bool transfer_unsupported(int32_t error)
+{
+  return error == EINVAL || error == ENOSYS || error == EXDEV || error == EOPNOTSUPP || error == EBADF;
+}
+
+/**
+ * @brief Write the whole buffer, retrying on short writes.
+ * @return `false` if the write failed.
+ */
+static bool transfer_write_all(int32_t file_descriptor, char *buffer, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t written = write(file_descriptor, buffer, length);
+    if (written == -1 && errno == EINTR)
+      continue;
+    if (written == -1)
+      return false;
+    buffer += written;
+    length -= written;
+  }
+  return true;
+}
+
+/**
+ * @brief Copy with `read()`/`write()` through the buffer.
+ * @param limit The number of bytes to copy, `0` to copy until the end of file.
+ * @return `false` if the copy failed.
+ */
+static bool transfer_buffered(int32_t input, int32_t output, size_t limit, char *buffer)
+{
+  bool limited = limit != 0;
+  while (!limited || limit > 0)
+  {
+    size_t length = limited && limit < TRANSFER_BUFFER_SIZE ? limit : TRANSFER_BUFFER_SIZE;
+    ssize_t result = read(input, buffer, length);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1)
+      return false;
+    if (result == 0)
+      return !limited;
+    if (!transfer_write_all(output, buffer, result))
+      return false;
+    limit -= limited ? result : 0;
+  }
+  return true;
+}
+
+/**
+ * @brief Move exactly `length` bytes out of the pipe with `splice()`, continuing with the buffer if the output refuses it.
+ */
+static bool transfer_drain(int32_t pipe, int32_t output, size_t length, char *buffer)
+{
+  while (length > 0)
+  {
+    ssize_t result = splice(pipe, NULL, output, NULL, length, SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result == -1 && transfer_unsupported(errno))
+      return transfer_buffered(pipe, output, length, buffer);
+    if (result <= 0)
+      return false;
+    length -= result;
+  }
+  return true;
+}
+
+/**
+ * @brief Copy from the input to the output until the end of file.
+ * Uses `copy_file_range()` between regular files, `splice()` if one side is a pipe and a buffered loop otherwise.
+ * @return `EXIT_SUCCESS` if everything was copied.
+ */
+int32_t transfer_copy(int32_t input, int32_t output)
+{
+  transfer_kind input_kind = transfer_get_kind(input), output_kind = transfer_get_kind(output);
+  if (input_kind == TRANSFER_FILE && output_kind == TRANSFER_FILE)
+  {
+    while (true)
+    {
+      ssize_t result = copy_file_range(input, NULL, output, NULL, TRANSFER_CHUNK_SIZE, 0);
+      if (result == -1 && errno == EINTR)
+        continue;
+      if (result == 0)
+        return EXIT_SUCCESS;
+      if (result == -1)
+        break;
+    }
+    if (!transfer_unsupported(errno))
+    {
+      logger(LOG_WARNING, "Failed to copy.\n");
+      return EXIT_FAILURE;
+    }
+  }
+  else if (input_kind == TRANSFER_PIPE || output_kind == TRANSFER_PIPE)
+  {
+    while (true)
+    {
+      ssize_t result = splice(input, NULL, output, NULL, TRANSFER_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (result == -1 && errno == EINTR)
+        continue;
+      if (result == 0)
+        return EXIT_SUCCESS;
+      if (result == -1)
+        break;
+    }
+    // The reader is gone, the copy is over
+    if (errno == EPIPE)
+      return EXIT_SUCCESS;
+    if (!transfer_unsupported(errno))
+    {
+      logger(LOG_WARNING, "Failed to splice.\n");
+      return EXIT_FAILURE;
+    }
+  }
+  char *buffer = memory_malloc(MEMORY_BUILTINS, TRANSFER_BUFFER_SIZE);
+  bool copied = transfer_buffered(input, output, 0, buffer);
+  int32_t error = errno;
+  memory_free(buffer);
+  if (!copied && error != EPIPE)
+  {
+    logger(LOG_WARNING, "Failed to copy.\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Copy from the input to every output until the end of file.
+ * If the input is a pipe, every chunk is duplicated with `tee()` into a private pipe and spliced to the outputs,
+ * the last output consumes the chunk from the input directly.
+ * @return `EXIT_SUCCESS` if everything was copied to every output.
+ */
+int32_t transfer_tee(int32_t input, int32_t *outputs, size_t count)
+{
+  if (count == 0)
+    return EXIT_SUCCESS;
+  if (count == 1)
+    return transfer_copy(input, outputs[0]);
+  char *buffer = memory_malloc(MEMORY_BUILTINS, TRANSFER_BUFFER_SIZE);
+  int32_t private_pipe[2] = {-1, -1};
+  bool zero_copy = transfer_get_kind(input) == TRANSFER_PIPE && pipe2(private_pipe, O_CLOEXEC) == 0;
+  if (zero_copy)
+  {
+    // The private pipe has to be able to hold everything the input holds
+    int32_t size = fcntl(input, F_GETPIPE_SZ);
+    if (size > 0)
+      fcntl(private_pipe[1], F_SETPIPE_SZ, size);
+  }
+  bool copied = true;
+  while (zero_copy && copied)
+  {
+    ssize_t length = tee(input, private_pipe[1], TRANSFER_CHUNK_SIZE, 0);
+    if (length == -1 && errno == EINTR)
+      continue;
+    if (length == -1 && transfer_unsupported(errno))
+    {
+      zero_copy = false;
+      break;
+    }
+    if (length <= 0)
+    {
+      copied = length == 0;
+      break;
+    }
+    copied = transfer_drain(private_pipe[0], outputs[0], length, buffer);
+    for (size_t i = 1; i <= count - 2 && copied; i++)
+    {
+      ssize_t duplicated;
+      do
+        duplicated = tee(input, private_pipe[1], length, 0);
+      while (duplicated == -1 && errno == EINTR);
+      copied = duplicated == length && transfer_drain(private_pipe[0], outputs[i], length, buffer);
+    }
+    copied = copied && transfer_drain(input, outputs[count - 1], length, buffer);
+  }
+  if (private_pipe[0] != -1)
+  {
+    close(private_pipe[0]);
+    close(private_pipe[1]);
+  }
+  while (!zero_copy && copied)
+  {
+    ssize_t result = read(input, buffer, TRANSFER_BUFFER_SIZE);
+    if (result == -1 && errno == EINTR)
+      continue;
+    if (result <= 0)
+    {
+      copied = result == 0;
+      break;
+    }
+    for (size_t i = 0; i <= count - 1; i++)
+      copied = transfer_write_all(outputs[i], buffer, result) && copied;
+  }
+  int32_t error = errno;
+  memory_free(buffer);
+  // An output whose reader is gone ends the copy, like `SIGPIPE` would
+  if (!copied && error != EPIPE)
+  {
+    logger(LOG_WARNING, "Failed to tee.\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bytes asked from the kernel per `splice()`, `tee()` or `copy_file_range()`
+#define TRANSFER_CHUNK_SIZE (1024 * 1024)
+// Size of the buffer of the `read()`/`write()` fallback
+#define TRANSFER_BUFFER_SIZE (1024 * 1024)
+
+int32_t transfer_copy(int32_t input, int32_t output);
+int32_t transfer_tee(int32_t input, int32_t *outputs, size_t count);